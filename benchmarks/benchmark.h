@@ -0,0 +1,67 @@
+/*
+ *
+ * flickrsync utility - Allocation counting and timing for the benchmarks
+ *
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <malloc.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <new>
+
+// Replaces the global operator new/delete, so include in one source file of each benchmark only.
+// Counts allocations and the heap bytes in use (as allocated by malloc, including its rounding).
+// The replacements are not inlined, so that the compiler does not pair new with free.
+std::atomic<unsigned long long> allocationCount{0};
+std::atomic<long long> heapBytesInUse{0};
+
+__attribute__((noinline)) void* operator new(size_t size)
+{
+  auto memory = malloc(size ? size : 1);
+  if (!memory)
+    throw std::bad_alloc();
+  ++allocationCount;
+  heapBytesInUse += malloc_usable_size(memory);
+  return memory;
+}
+
+void* operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+__attribute__((noinline)) void operator delete(void* memory) noexcept
+{
+  if (!memory)
+    return;
+  heapBytesInUse -= malloc_usable_size(memory);
+  free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+  operator delete(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+  operator delete(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+  operator delete(memory);
+}
+
+// Seconds elapsed since start
+inline double secondsSince(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+#endif // BENCHMARK_H
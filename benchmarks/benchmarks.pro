@@ -0,0 +1,8 @@
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    mockflickr \
+    photosetbench \
+    scannerbench \
+    titleindexbench \
+    titlepolicybench
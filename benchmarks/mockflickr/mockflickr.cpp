@@ -0,0 +1,787 @@
+/*
+ *
+ * flickrsync utility - Local stand-in for Flickr REST, upload and photo source endpoints
+ *
+ */
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+
+// Photo ids above INT_MAX, like the ids Flickr gives today
+const unsigned long long FIRST_PHOTO_ID{52000000000ULL};
+const unsigned long long FIRST_SET_ID{72177720300000000ULL};
+const int MAX_PAGE_SIZE{500};
+const time_t FIRST_DATE_TAKEN{1262340000}; // 2010-01-01 10:00:00 UTC
+
+// Flickr API error codes
+const int NOT_FOUND_ERROR{1};
+const int PHOTO_NOT_FOUND_ERROR{2};
+const int ALREADY_IN_SET_ERROR{3};
+const int METHOD_NOT_FOUND_ERROR{112};
+
+struct mockPhoto {
+  string title;
+  string dateTaken;
+  string description;
+  string media;
+  string originalFormat;
+  string secret;
+  string originalSecret;
+  string server;
+  string machineTags;
+  long long dateUploaded;
+  size_t bytes;
+};
+
+struct mockSet {
+  string title;
+  string primary;
+  vector<string> photoIds;
+};
+
+struct serverOptions {
+  int port{8089};
+  chrono::milliseconds latency{0};
+  size_t photoBytes{4096};
+  int duplicatePercent{0};
+  bool shuffle{false};
+  bool verbose{false};
+};
+
+static serverOptions options;
+static mutex stateMutex;
+static map<string,mockPhoto> photos;
+static map<string,mockSet> sets;
+static unsigned long long nextPhotoId{FIRST_PHOTO_ID};
+static unsigned long long nextSetId{FIRST_SET_ID};
+
+namespace {
+
+struct httpRequest {
+  string method;
+  string path;
+  map<string,string> headers;
+  string body;
+};
+
+struct httpResponse {
+  int status{200};
+  string contentType{"text/xml; charset=utf-8"};
+  string body;
+  vector<string> headers;
+};
+
+}
+
+static string dateString(time_t time)
+{
+  char date[32];
+  struct tm fields;
+  gmtime_r(&time, &fields);
+  strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &fields);
+  return date;
+}
+
+static string hexString(unsigned long long value, int digits)
+{
+  char hex[20];
+  snprintf(hex, sizeof(hex), "%0*llx", digits, value & ((1ULL << (4 * digits)) - 1));
+  return hex;
+}
+
+static string xmlEscape(const string& value)
+{
+  string escaped;
+  escaped.reserve(value.size());
+  for (auto c : value)
+    switch (c)
+    {
+    case '&': escaped += "&amp;"; break;
+    case '<': escaped += "&lt;"; break;
+    case '>': escaped += "&gt;"; break;
+    case '"': escaped += "&quot;"; break;
+    default: escaped += c;
+    }
+  return escaped;
+}
+
+static string urlDecode(const string& value)
+{
+  string decoded;
+  decoded.reserve(value.size());
+  for (size_t i = 0; i < value.size(); ++i)
+    if (value[i] == '+')
+      decoded += ' ';
+    else if (value[i] == '%' && i + 2 < value.size())
+    {
+      decoded += static_cast<char>(strtol(value.substr(i + 1, 2).c_str(), nullptr, 16));
+      i += 2;
+    }
+    else
+      decoded += value[i];
+  return decoded;
+}
+
+static void parseParameters(const string& encoded, map<string,string>* parameters)
+{
+  for (size_t start = 0, end; start < encoded.size(); start = end + 1)
+  {
+    end = min(encoded.find('&', start), encoded.size());
+    auto pair = encoded.substr(start, end - start);
+    auto equals = pair.find('=');
+    if (equals != string::npos)
+      (*parameters)[urlDecode(pair.substr(0, equals))] = urlDecode(pair.substr(equals + 1));
+  }
+}
+
+// Multipart form fields of upload, the photo file is recorded only by its size
+static void parseMultipart(const httpRequest& request, map<string,string>* parameters, size_t* fileBytes)
+{
+  auto contentType = request.headers.count("content-type") ? request.headers.at("content-type") : "";
+  auto boundaryStart = contentType.find("boundary=");
+  if (boundaryStart == string::npos)
+    return;
+  auto boundary = "--" + contentType.substr(boundaryStart + strlen("boundary="));
+  if (boundary.size() > 2 && boundary[2] == '"')
+    boundary = "--" + boundary.substr(3, boundary.find('"', 3) - 3);
+
+  const auto& body = request.body;
+  for (auto part = body.find(boundary); part != string::npos; )
+  {
+    auto headersStart = part + boundary.size() + 2;
+    auto headersEnd = body.find("\r\n\r\n", headersStart);
+    auto next = headersEnd == string::npos ? string::npos : body.find("\r\n" + boundary, headersEnd);
+    if (next == string::npos)
+      break;
+    auto headers = body.substr(headersStart, headersEnd - headersStart);
+    auto dataStart = headersEnd + 4;
+    auto nameStart = headers.find("name=\"");
+    if (nameStart != string::npos)
+    {
+      nameStart += strlen("name=\"");
+      auto name = headers.substr(nameStart, headers.find('"', nameStart) - nameStart);
+      if (headers.find("filename=\"") != string::npos)
+        *fileBytes = next - dataStart;
+      else
+        (*parameters)[name] = body.substr(dataStart, next - dataStart);
+    }
+    part = next + 2;
+  }
+}
+
+static string errorResponse(int code, const string& message)
+{
+  return "<?xml version=\"1.0\" encoding=\"utf-8\" ?>\n<rsp stat=\"fail\">\n\t<err code=\"" + to_string(code) +
+      "\" msg=\"" + xmlEscape(message) + "\" />\n</rsp>\n";
+}
+
+static string okResponse(const string& content)
+{
+  return "<?xml version=\"1.0\" encoding=\"utf-8\" ?>\n<rsp stat=\"ok\">\n" + content + "</rsp>\n";
+}
+
+static string photoSourcePath(const string& photoId, const mockPhoto& photo, const char* suffix, const string& format)
+{
+  return "/photos/" + photo.server + '/' + photoId + '_' + (strcmp(suffix, "o") ? photo.secret : photo.originalSecret) +
+      '_' + suffix + '.' + format;
+}
+
+static string sourceUrl(const httpRequest& request, const string& path)
+{
+  auto host = request.headers.count("host") ? request.headers.at("host") : "127.0.0.1:" + to_string(options.port);
+  return "http://" + host + path;
+}
+
+// Photo element of list responses, with the extras flickrsync asks for
+static string listedPhotoXml(const string& photoId, const mockPhoto& photo, const string& primary)
+{
+  return "\t\t<photo id=\"" + photoId + "\" secret=\"" + photo.secret + "\" server=\"" + photo.server +
+      "\" farm=\"66\" title=\"" + xmlEscape(photo.title) + "\" isprimary=\"" + (photoId == primary ? "1" : "0") +
+      "\" dateupload=\"" + to_string(photo.dateUploaded) + "\" datetaken=\"" + photo.dateTaken +
+      "\" datetakengranularity=\"0\" datetakenunknown=\"0\" originalsecret=\"" + photo.originalSecret +
+      "\" originalformat=\"" + photo.originalFormat + "\" media=\"" + photo.media +
+      "\" media_status=\"ready\" machine_tags=\"" + xmlEscape(photo.machineTags) + "\">\n\t\t\t<description>" +
+      xmlEscape(photo.description) + "</description>\n\t\t</photo>\n";
+}
+
+static int pageParameter(const map<string,string>& parameters, const char* name, int defaultValue, int maxValue)
+{
+  auto value = parameters.count(name) ? atoi(parameters.at(name).c_str()) : 0;
+  return value > 0 ? min(value, maxValue) : defaultValue;
+}
+
+static string getList()
+{
+  string content = "\t<photosets page=\"1\" pages=\"1\" perpage=\"" + to_string(sets.size()) + "\" total=\"" +
+      to_string(sets.size()) + "\" cancreate=\"1\">\n";
+  for (const auto& set : sets)
+  {
+    int photoCount{0};
+    int videoCount{0};
+    for (const auto& photoId : set.second.photoIds)
+      ++(photos[photoId].media == "video" ? videoCount : photoCount);
+    content += "\t\t<photoset id=\"" + set.first + "\" primary=\"" + set.second.primary +
+        "\" secret=\"0\" server=\"65535\" farm=\"66\" photos=\"" + to_string(photoCount) + "\" videos=\"" +
+        to_string(videoCount) + "\">\n\t\t\t<title>" + xmlEscape(set.second.title) +
+        "</title>\n\t\t\t<description />\n\t\t</photoset>\n";
+  }
+  return okResponse(content + "\t</photosets>\n");
+}
+
+static string getPhotos(const map<string,string>& parameters)
+{
+  auto set = sets.find(parameters.count("photoset_id") ? parameters.at("photoset_id") : "");
+  if (set == sets.end())
+    return errorResponse(NOT_FOUND_ERROR, "Photoset not found");
+
+  const auto& photoIds = set->second.photoIds;
+  auto perPage = pageParameter(parameters, "per_page", MAX_PAGE_SIZE, MAX_PAGE_SIZE);
+  auto page = pageParameter(parameters, "page", 1, INT32_MAX);
+  auto pages = max<size_t>(1, (photoIds.size() + perPage - 1) / perPage);
+  string content = "\t<photoset id=\"" + set->first + "\" primary=\"" + set->second.primary +
+      "\" owner=\"00000000@N00\" ownername=\"bench\" page=\"" + to_string(page) + "\" per_page=\"" +
+      to_string(perPage) + "\" perpage=\"" + to_string(perPage) + "\" pages=\"" + to_string(pages) + "\" title=\"" +
+      xmlEscape(set->second.title) + "\" total=\"" + to_string(photoIds.size()) + "\">\n";
+  for (auto i = static_cast<size_t>(page - 1) * perPage; i < photoIds.size() && i < static_cast<size_t>(page) * perPage; ++i)
+    content += listedPhotoXml(photoIds[i], photos[photoIds[i]], set->second.primary);
+  return okResponse(content + "\t</photoset>\n");
+}
+
+static string getPeoplePhotos(const map<string,string>& parameters)
+{
+  auto minUploadDate = parameters.count("min_upload_date") ? atoll(parameters.at("min_upload_date").c_str()) : 0;
+  vector<const pair<const string,mockPhoto>*> listed;
+  for (const auto& photo : photos)
+    if (photo.second.dateUploaded >= minUploadDate)
+      listed.push_back(&photo);
+
+  auto perPage = pageParameter(parameters, "per_page", 100, MAX_PAGE_SIZE);
+  auto page = pageParameter(parameters, "page", 1, INT32_MAX);
+  auto pages = max<size_t>(1, (listed.size() + perPage - 1) / perPage);
+  string content = "\t<photos page=\"" + to_string(page) + "\" pages=\"" + to_string(pages) + "\" perpage=\"" +
+      to_string(perPage) + "\" total=\"" + to_string(listed.size()) + "\">\n";
+  for (auto i = static_cast<size_t>(page - 1) * perPage; i < listed.size() && i < static_cast<size_t>(page) * perPage; ++i)
+    content += listedPhotoXml(listed[i]->first, listed[i]->second, "");
+  return okResponse(content + "\t</photos>\n");
+}
+
+static string getInfo(const map<string,string>& parameters)
+{
+  auto photo = photos.find(parameters.count("photo_id") ? parameters.at("photo_id") : "");
+  if (photo == photos.end())
+    return errorResponse(NOT_FOUND_ERROR, "Photo not found");
+
+  const auto& info = photo->second;
+  string tags;
+  if (!info.machineTags.empty())
+    tags = "\t\t\t<tag id=\"1-" + photo->first + "-1\" author=\"00000000@N00\" authorname=\"bench\" raw=\"" +
+        xmlEscape(info.machineTags) + "\" machine_tag=\"1\">" + xmlEscape(info.machineTags) + "</tag>\n";
+  return okResponse("\t<photo id=\"" + photo->first + "\" secret=\"" + info.secret + "\" server=\"" + info.server +
+                    "\" farm=\"66\" dateuploaded=\"" + to_string(info.dateUploaded) +
+                    "\" isfavorite=\"0\" license=\"0\" safety_level=\"0\" rotation=\"0\" originalsecret=\"" +
+                    info.originalSecret + "\" originalformat=\"" + info.originalFormat + "\" views=\"0\" media=\"" +
+                    info.media + "\">\n\t\t<owner nsid=\"00000000@N00\" username=\"bench\" />\n\t\t<title>" +
+                    xmlEscape(info.title) + "</title>\n\t\t<description>" + xmlEscape(info.description) +
+                    "</description>\n\t\t<visibility ispublic=\"0\" isfriend=\"0\" isfamily=\"1\" />\n"
+                    "\t\t<dates posted=\"" + to_string(info.dateUploaded) + "\" taken=\"" + info.dateTaken +
+                    "\" takengranularity=\"0\" takenunknown=\"0\" lastupdate=\"" + to_string(info.dateUploaded) +
+                    "\" />\n\t\t<tags>\n" + tags + "\t\t</tags>\n\t</photo>\n");
+}
+
+static string getSizes(const httpRequest& request, const map<string,string>& parameters)
+{
+  auto photo = photos.find(parameters.count("photo_id") ? parameters.at("photo_id") : "");
+  if (photo == photos.end())
+    return errorResponse(NOT_FOUND_ERROR, "Photo not found");
+
+  auto size = [&](const char* label, int width, const char* suffix, const string& format, const char* media)
+  {
+    return string("\t\t<size label=\"") + label + "\" width=\"" + to_string(width) + "\" height=\"" +
+        to_string(width * 3 / 4) + "\" source=\"" +
+        xmlEscape(sourceUrl(request, photoSourcePath(photo->first, photo->second, suffix, format))) +
+        "\" url=\"https://www.flickr.com/photos/bench/" + photo->first + "/\" media=\"" + media + "\" />\n";
+  };
+  string content = "\t<sizes canblog=\"0\" canprint=\"0\" candownload=\"1\">\n";
+  content += size("Large", 1024, "b", "jpg", "photo");
+  content += size("Large 2048", 2048, "k", "jpg", "photo");
+  content += size("Original", 4000, "o", photo->second.originalFormat, "photo");
+  if (photo->second.media == "video")
+    content += size("Video Original", 1920, "v", "mp4", "video");
+  return okResponse(content + "\t</sizes>\n");
+}
+
+static string createSet(const map<string,string>& parameters)
+{
+  auto primary = parameters.count("primary_photo_id") ? parameters.at("primary_photo_id") : "";
+  if (!photos.count(primary))
+    return errorResponse(PHOTO_NOT_FOUND_ERROR, "Photo not found");
+  auto setId = to_string(nextSetId++);
+  auto& set = sets[setId];
+  set.title = parameters.count("title") ? parameters.at("title") : "";
+  set.primary = primary;
+  set.photoIds.push_back(primary);
+  return okResponse("\t<photoset id=\"" + setId + "\" url=\"https://www.flickr.com/photos/bench/sets/" + setId +
+                    "/\" />\n");
+}
+
+static string addPhoto(const map<string,string>& parameters)
+{
+  auto set = sets.find(parameters.count("photoset_id") ? parameters.at("photoset_id") : "");
+  if (set == sets.end())
+    return errorResponse(NOT_FOUND_ERROR, "Photoset not found");
+  auto photoId = parameters.count("photo_id") ? parameters.at("photo_id") : "";
+  if (!photos.count(photoId))
+    return errorResponse(PHOTO_NOT_FOUND_ERROR, "Photo not found");
+  auto& photoIds = set->second.photoIds;
+  if (find(photoIds.begin(), photoIds.end(), photoId) != photoIds.end())
+    return errorResponse(ALREADY_IN_SET_ERROR, "Photo already in set");
+  photoIds.push_back(photoId);
+  return okResponse("");
+}
+
+// Listed photos are moved to the front of the set in the given order, the others keep their order after them
+static string reorderPhotos(const map<string,string>& parameters)
+{
+  auto set = sets.find(parameters.count("photoset_id") ? parameters.at("photoset_id") : "");
+  if (set == sets.end())
+    return errorResponse(NOT_FOUND_ERROR, "Photoset not found");
+
+  auto& photoIds = set->second.photoIds;
+  unordered_set<string> inSet(photoIds.begin(), photoIds.end());
+  vector<string> reordered;
+  unordered_set<string> moved;
+  const auto& listed = parameters.count("photo_ids") ? parameters.at("photo_ids") : "";
+  for (size_t start = 0, end; start < listed.size(); start = end + 1)
+  {
+    end = min(listed.find(',', start), listed.size());
+    auto photoId = listed.substr(start, end - start);
+    if (inSet.count(photoId) && moved.insert(photoId).second)
+      reordered.push_back(photoId);
+  }
+  for (const auto& photoId : photoIds)
+    if (!moved.count(photoId))
+      reordered.push_back(photoId);
+  photoIds.swap(reordered);
+  return okResponse("");
+}
+
+static string setMeta(const map<string,string>& parameters)
+{
+  auto photo = photos.find(parameters.count("photo_id") ? parameters.at("photo_id") : "");
+  if (photo == photos.end())
+    return errorResponse(NOT_FOUND_ERROR, "Photo not found");
+  photo->second.title = parameters.count("title") ? parameters.at("title") : "";
+  photo->second.description = parameters.count("description") ? parameters.at("description") : "";
+  return okResponse("");
+}
+
+static string deletePhoto(const map<string,string>& parameters)
+{
+  auto photoId = parameters.count("photo_id") ? parameters.at("photo_id") : "";
+  if (!photos.erase(photoId))
+    return errorResponse(NOT_FOUND_ERROR, "Photo not found");
+  // Flickr deletes sets that become empty
+  for (auto set = sets.begin(); set != sets.end(); )
+  {
+    auto& photoIds = set->second.photoIds;
+    photoIds.erase(remove(photoIds.begin(), photoIds.end(), photoId), photoIds.end());
+    if (photoIds.empty())
+      set = sets.erase(set);
+    else
+    {
+      if (set->second.primary == photoId)
+        set->second.primary = photoIds.front();
+      ++set;
+    }
+  }
+  return okResponse("");
+}
+
+static string newPhotoId()
+{
+  return to_string(nextPhotoId++);
+}
+
+static mockPhoto newPhoto(const string& title, const string& dateTaken, size_t bytes)
+{
+  mockPhoto photo;
+  photo.title = title;
+  photo.dateTaken = dateTaken;
+  photo.media = "photo";
+  photo.originalFormat = "jpg";
+  photo.secret = hexString(nextPhotoId * 2654435761ULL, 10);
+  photo.originalSecret = hexString(nextPhotoId * 40503ULL, 10);
+  photo.server = to_string(65535 - static_cast<int>(nextPhotoId % 1000));
+  photo.dateUploaded = time(nullptr);
+  photo.bytes = bytes;
+  return photo;
+}
+
+static string upload(const httpRequest& request)
+{
+  map<string,string> parameters;
+  size_t fileBytes{0};
+  parseMultipart(request, &parameters, &fileBytes);
+  if (!fileBytes)
+    return errorResponse(2, "No photo specified");
+
+  auto photo = newPhoto(parameters["title"], dateString(time(nullptr)), fileBytes);
+  // Content hash is sent as machine tag, other tags are not needed by flickrsync
+  const auto& tags = parameters["tags"];
+  if (tags.find(':') != string::npos)
+    photo.machineTags = tags;
+  auto photoId = newPhotoId();
+  photos[photoId] = photo;
+  return okResponse("\t<photoid>" + photoId + "</photoid>\n");
+}
+
+static string restCall(const httpRequest& request, const map<string,string>& parameters)
+{
+  const auto& method = parameters.at("method");
+  if (method == "flickr.photosets.getList")
+    return getList();
+  if (method == "flickr.photosets.getPhotos")
+    return getPhotos(parameters);
+  if (method == "flickr.photosets.create")
+    return createSet(parameters);
+  if (method == "flickr.photosets.addPhoto")
+    return addPhoto(parameters);
+  if (method == "flickr.photosets.reorderPhotos")
+    return reorderPhotos(parameters);
+  if (method == "flickr.photos.setMeta")
+    return setMeta(parameters);
+  if (method == "flickr.photos.delete")
+    return deletePhoto(parameters);
+  if (method == "flickr.photos.getSizes")
+    return getSizes(request, parameters);
+  if (method == "flickr.photos.getInfo")
+    return getInfo(parameters);
+  if (method == "flickr.people.getPhotos")
+    return getPeoplePhotos(parameters);
+  return errorResponse(METHOD_NOT_FOUND_ERROR, "Method \"" + method + "\" not found");
+}
+
+// Photo/video file of /photos/{server}/{id}_{secret}_{size}.{format}, with range requests for resumed downloads
+static httpResponse photoFile(const httpRequest& request)
+{
+  httpResponse response;
+  auto fileName = request.path.substr(request.path.rfind('/') + 1);
+  auto photoId = fileName.substr(0, fileName.find('_'));
+  size_t bytes{0};
+  {
+    lock_guard<mutex> lock(stateMutex);
+    auto photo = photos.find(photoId);
+    if (photo == photos.end())
+    {
+      response.status = 404;
+      response.contentType = "text/plain";
+      response.body = "Not found\n";
+      return response;
+    }
+    // Resized photos are smaller than the original
+    bytes = fileName.find("_o.") != string::npos ? photo->second.bytes : photo->second.bytes / 2;
+  }
+
+  response.contentType = "application/octet-stream";
+  size_t start{0};
+  if (request.headers.count("range"))
+  {
+    start = strtoull(request.headers.at("range").c_str() + strlen("bytes="), nullptr, 10);
+    if (start >= bytes)
+    {
+      response.status = 416;
+      response.contentType = "text/plain";
+      response.headers.push_back("Content-Range: bytes */" + to_string(bytes));
+      return response;
+    }
+    response.status = 206;
+    response.headers.push_back("Content-Range: bytes " + to_string(start) + '-' + to_string(bytes - 1) + '/' +
+                               to_string(bytes));
+  }
+  // Content depends on the photo id and the position, so resumed downloads can be checked
+  auto seed = strtoull(photoId.c_str(), nullptr, 10);
+  response.body.resize(bytes - start);
+  for (auto i = start; i < bytes; ++i)
+    response.body[i - start] = static_cast<char>((seed + i * 31) >> 3);
+  return response;
+}
+
+static httpResponse handle(const httpRequest& request)
+{
+  map<string,string> parameters;
+  auto queryStart = request.path.find('?');
+  if (queryStart != string::npos)
+    parseParameters(request.path.substr(queryStart + 1), &parameters);
+  auto contentType = request.headers.count("content-type") ? request.headers.at("content-type") : "";
+  auto multipart = contentType.compare(0, strlen("multipart/form-data"), "multipart/form-data") == 0;
+  if (request.method == "POST" && !multipart)
+    parseParameters(request.body, &parameters);
+
+  httpResponse response;
+  if (multipart || parameters.count("method"))
+  {
+    this_thread::sleep_for(options.latency);
+    lock_guard<mutex> lock(stateMutex);
+    response.body = multipart ? upload(request) : restCall(request, parameters);
+  }
+  else if (request.method == "GET" && request.path.compare(0, strlen("/photos/"), "/photos/") == 0)
+    response = photoFile(request);
+  else
+  {
+    response.status = 404;
+    response.contentType = "text/plain";
+    response.body = "Not found\n";
+  }
+  if (options.verbose)
+    fprintf(stderr, "%s %s %s => %d\n", request.method.c_str(), request.path.substr(0, queryStart).c_str(),
+            parameters.count("method") ? parameters["method"].c_str() : "", response.status);
+  return response;
+}
+
+static bool sendAll(int fd, const char* data, size_t length)
+{
+  while (length)
+  {
+    auto sent = send(fd, data, length, MSG_NOSIGNAL);
+    if (sent <= 0)
+      return false;
+    data += sent;
+    length -= sent;
+  }
+  return true;
+}
+
+static const char* statusText(int status)
+{
+  switch (status)
+  {
+  case 200: return "OK";
+  case 206: return "Partial Content";
+  case 404: return "Not Found";
+  case 416: return "Range Not Satisfiable";
+  default: return "Bad Request";
+  }
+}
+
+// Reads until buffer has length bytes, returns false when the connection is closed first
+static bool receive(int fd, string* buffer, size_t length)
+{
+  char data[65536];
+  while (buffer->size() < length)
+  {
+    auto received = recv(fd, data, sizeof(data), 0);
+    if (received <= 0)
+      return false;
+    buffer->append(data, received);
+  }
+  return true;
+}
+
+// Reads request from the start of buffer, leaving the bytes of the next request in it
+static bool readRequest(int fd, string* buffer, httpRequest* request)
+{
+  size_t headersEnd;
+  while ((headersEnd = buffer->find("\r\n\r\n")) == string::npos)
+    if (!receive(fd, buffer, buffer->size() + 1))
+      return false;
+
+  auto lineEnd = buffer->find("\r\n");
+  auto requestLine = buffer->substr(0, lineEnd);
+  auto methodEnd = requestLine.find(' ');
+  auto pathEnd = requestLine.find(' ', methodEnd + 1);
+  if (methodEnd == string::npos || pathEnd == string::npos)
+    return false;
+  request->method = requestLine.substr(0, methodEnd);
+  request->path = requestLine.substr(methodEnd + 1, pathEnd - methodEnd - 1);
+  request->headers.clear();
+  for (auto line = lineEnd + 2; line < headersEnd; )
+  {
+    auto end = buffer->find("\r\n", line);
+    auto header = buffer->substr(line, end - line);
+    auto colon = header.find(':');
+    if (colon != string::npos)
+    {
+      auto name = header.substr(0, colon);
+      transform(name.begin(), name.end(), name.begin(), ::tolower);
+      auto value = header.substr(header.find_first_not_of(' ', colon + 1));
+      request->headers[name] = value;
+    }
+    line = end + 2;
+  }
+  buffer->erase(0, headersEnd + 4);
+
+  // curl waits for the go-ahead before sending large upload bodies
+  if (request->headers.count("expect") && !sendAll(fd, "HTTP/1.1 100 Continue\r\n\r\n", 25))
+    return false;
+
+  request->body.clear();
+  if (request->headers.count("transfer-encoding") && request->headers.at("transfer-encoding") == "chunked")
+    for (;;)
+    {
+      size_t sizeEnd;
+      while ((sizeEnd = buffer->find("\r\n")) == string::npos)
+        if (!receive(fd, buffer, buffer->size() + 1))
+          return false;
+      auto chunkSize = strtoull(buffer->c_str(), nullptr, 16);
+      if (!receive(fd, buffer, sizeEnd + 2 + chunkSize + 2))
+        return false;
+      request->body.append(*buffer, sizeEnd + 2, chunkSize);
+      buffer->erase(0, sizeEnd + 2 + chunkSize + 2);
+      if (!chunkSize)
+        return true;
+    }
+
+  auto contentLength = request->headers.count("content-length") ? strtoull(request->headers.at("content-length").c_str(),
+                                                                           nullptr, 10) : 0;
+  if (!receive(fd, buffer, contentLength))
+    return false;
+  request->body = buffer->substr(0, contentLength);
+  buffer->erase(0, contentLength);
+  return true;
+}
+
+static void serveConnection(int fd)
+{
+  string buffer;
+  httpRequest request;
+  while (readRequest(fd, &buffer, &request))
+  {
+    auto response = handle(request);
+    auto close = request.headers.count("connection") && request.headers.at("connection") == "close";
+    string head = "HTTP/1.1 " + to_string(response.status) + ' ' + statusText(response.status) + "\r\nContent-Type: " +
+        response.contentType + "\r\nContent-Length: " + to_string(response.body.size()) + "\r\n";
+    for (const auto& header : response.headers)
+      head += header + "\r\n";
+    head += close ? "Connection: close\r\n\r\n" : "\r\n";
+    if (!sendAll(fd, head.data(), head.size()) ||
+        (request.method != "HEAD" && !sendAll(fd, response.body.data(), response.body.size())) || close)
+      break;
+  }
+  ::close(fd);
+}
+
+// Adds set of count photos titled img-000001..., taken a minute apart. With duplicates, the given
+// percentage of photos gets an identical copy, and with shuffle the set is not in title order.
+static void addSyntheticSet(const string& title, size_t count)
+{
+  auto& set = sets[to_string(nextSetId++)];
+  set.title = title;
+  int duplicateInterval = options.duplicatePercent > 0 ? max(1, 100 / options.duplicatePercent) : 0;
+  for (size_t i = 0; i < count; ++i)
+  {
+    char photoTitle[32];
+    snprintf(photoTitle, sizeof(photoTitle), "img-%06zu", i + 1);
+    auto photo = newPhoto(photoTitle, dateString(FIRST_DATE_TAKEN + 60 * static_cast<time_t>(i)), options.photoBytes);
+    photo.dateUploaded = FIRST_DATE_TAKEN + 60 * static_cast<time_t>(i);
+    auto photoId = newPhotoId();
+    photos[photoId] = photo;
+    set.photoIds.push_back(photoId);
+    if (duplicateInterval && i % duplicateInterval == 0)
+    {
+      auto duplicateId = newPhotoId();
+      photos[duplicateId] = photo;
+      set.photoIds.push_back(duplicateId);
+    }
+  }
+  if (options.shuffle)
+    shuffle(set.photoIds.begin(), set.photoIds.end(), default_random_engine(count));
+  if (!set.photoIds.empty())
+    set.primary = set.photoIds.front();
+}
+
+static void printHelp(const char* program)
+{
+  printf("Local stand-in for Flickr REST, upload and photo source endpoints\n\n"
+         "Usage: %s [OPTIONS]\n\n"
+         "  --port {port}          Port to listen on 127.0.0.1 (default 8089)\n"
+         "  --latency-ms {ms}      Delay of each API call and upload (default 0)\n"
+         "  --set {title}:{count}  Add photoset with count synthetic photos titled img-000001...\n"
+         "  --duplicates {pct}     Add an identical copy of pct%% of the synthetic photos (default 0)\n"
+         "  --shuffle              Leave synthetic photosets out of title order\n"
+         "  --photo-bytes {n}      Size of synthetic original photo files (default 4096)\n"
+         "  --verbose              Log each request to stderr\n\n"
+         "Point flickrsync at it with FLICKRSYNC_API_URI=http://127.0.0.1:{port}/services/rest/,\n"
+         "FLICKRSYNC_UPLOAD_URI=http://127.0.0.1:{port}/services/upload/ and\n"
+         "FLICKRSYNC_PHOTO_SOURCE_URL=http://127.0.0.1:{port}/photos/\n", program);
+}
+
+int main(int argc, char** argv)
+{
+  vector<pair<string,size_t>> syntheticSets;
+  for (int i = 1; i < argc; ++i)
+  {
+    string option = argv[i];
+    auto value = i + 1 < argc ? argv[i + 1] : "";
+    if (option == "--port" && *value)
+      options.port = atoi(argv[++i]);
+    else if (option == "--latency-ms" && *value)
+      options.latency = chrono::milliseconds(atoi(argv[++i]));
+    else if (option == "--duplicates" && *value)
+      options.duplicatePercent = atoi(argv[++i]);
+    else if (option == "--photo-bytes" && *value)
+      options.photoBytes = strtoull(argv[++i], nullptr, 10);
+    else if (option == "--shuffle")
+      options.shuffle = true;
+    else if (option == "--verbose")
+      options.verbose = true;
+    else if (option == "--set" && strchr(value, ':'))
+    {
+      string set = argv[++i];
+      auto colon = set.rfind(':');
+      syntheticSets.emplace_back(set.substr(0, colon), strtoull(set.c_str() + colon + 1, nullptr, 10));
+    }
+    else
+    {
+      printHelp(argv[0]);
+      return option == "--help" || option == "-h" ? 0 : 1;
+    }
+  }
+  for (const auto& set : syntheticSets)
+    addSyntheticSet(set.first, set.second);
+
+  auto listener = socket(AF_INET, SOCK_STREAM, 0);
+  int enable{1};
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(options.port);
+  if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) ||
+      listen(listener, SOMAXCONN))
+  {
+    fprintf(stderr, "ERROR: Unable to listen on port %d: %s\n", options.port, strerror(errno));
+    return 1;
+  }
+  printf("Mock Flickr listening on http://127.0.0.1:%d/ with %zu photos in %zu sets\n", options.port, photos.size(),
+         sets.size());
+  fflush(stdout);
+
+  for (;;)
+  {
+    auto fd = accept(listener, nullptr, nullptr);
+    if (fd < 0)
+      continue;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    thread(serveConnection, fd).detach();
+  }
+}
@@ -0,0 +1,9 @@
+TEMPLATE = app
+CONFIG -= qt
+CONFIG += console
+CONFIG += c++-11
+CONFIG += thread
+CONFIG -= app_bundle
+
+SOURCES += \
+    mockflickr.cpp
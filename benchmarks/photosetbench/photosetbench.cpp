@@ -0,0 +1,279 @@
+/*
+ *
+ * flickrsync utility - Memory benchmark of the compact photo set
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../benchmark.h"
+#include "../../duplicates.h"
+#include "../../photoset.h"
+
+using namespace std;
+
+const size_t DEFAULT_PHOTOS{1000000};
+
+// Reference implementation, the node map photo set with pointer indexes used before the compact one
+class ReferencePhotoSet
+{
+public:
+  void add(const string& photoId, photoInfo info)
+  {
+    auto existing = photos.find(photoId);
+    if (existing != photos.end())
+    {
+      unindex(*existing);
+      existing->second = move(info);
+    }
+    else
+      existing = photos.emplace(photoId, move(info)).first;
+    index(*existing);
+  }
+
+  bool hasTitle(const string& title) const
+  {
+    return photosByTitle.find(&title) != photosByTitle.end();
+  }
+
+  bool hasContentHash(const string& contentHash) const
+  {
+    return contentHashes.find(&contentHash) != contentHashes.end();
+  }
+
+  bool hasPhoto(const string& title, const string& contentHash) const
+  {
+    if (contentHash.empty())
+      return hasTitle(title);
+    if (hasContentHash(contentHash))
+      return true;
+    auto photosWithTitle = photosByTitle.equal_range(&title);
+    for (auto photo = photosWithTitle.first; photo != photosWithTitle.second; ++photo)
+      if (photo->second->second.contentHash.empty())
+        return true;
+    return false;
+  }
+
+  size_t size() const { return photos.size(); }
+  map<string,photoInfo>::const_iterator begin() const { return photos.begin(); }
+  map<string,photoInfo>::const_iterator end() const { return photos.end(); }
+
+private:
+  typedef map<string,photoInfo>::value_type photoEntry;
+
+  struct stringPointerHash {
+    size_t operator()(const string* value) const { return hash<string>()(*value); }
+  };
+  struct stringPointerEqual {
+    bool operator()(const string* a, const string* b) const { return *a == *b; }
+  };
+
+  void index(const photoEntry& photo)
+  {
+    photosByTitle.emplace(&photo.second.title, &photo);
+    if (!photo.second.contentHash.empty())
+      contentHashes.insert(&photo.second.contentHash);
+  }
+
+  void unindex(const photoEntry& photo)
+  {
+    auto photosWithTitle = photosByTitle.equal_range(&photo.second.title);
+    for (auto entry = photosWithTitle.first; entry != photosWithTitle.second; ++entry)
+      if (entry->second == &photo)
+      {
+        photosByTitle.erase(entry);
+        break;
+      }
+    auto hashes = contentHashes.equal_range(&photo.second.contentHash);
+    for (auto hash = hashes.first; hash != hashes.second; ++hash)
+      if (*hash == &photo.second.contentHash)
+      {
+        contentHashes.erase(hash);
+        break;
+      }
+  }
+
+  map<string,photoInfo> photos;
+  unordered_multimap<const string*,const photoEntry*,stringPointerHash,stringPointerEqual> photosByTitle;
+  unordered_multiset<const string*,stringPointerHash,stringPointerEqual> contentHashes;
+};
+
+namespace {
+
+struct duplicateKey {
+  const photoInfo* info;
+
+  bool operator==(const duplicateKey& other) const
+  {
+    return info->title == other.info->title &&
+        info->dateTaken == other.info->dateTaken &&
+        info->description == other.info->description;
+  }
+};
+
+struct duplicateKeyHash {
+  size_t operator()(const duplicateKey& key) const
+  {
+    hash<string> stringHash;
+    auto result = stringHash(key.info->title);
+    result ^= stringHash(key.info->dateTaken) + 0x9e3779b97f4a7c15ULL + (result << 6) + (result >> 2);
+    result ^= stringHash(key.info->description) + 0x9e3779b97f4a7c15ULL + (result << 6) + (result >> 2);
+    return result;
+  }
+};
+
+struct result {
+  double bytesPerPhoto{0};
+  double addSeconds{0};
+  double lookupSeconds{0};
+  double duplicatesSeconds{0};
+  size_t found{0};
+  vector<duplicatePhoto> duplicates;
+};
+
+}
+
+// Reference implementation, findDuplicates hashing the metadata strings of the node map photo set
+static vector<duplicatePhoto> findDuplicates(const ReferencePhotoSet& photos)
+{
+  unordered_map<duplicateKey,const string*,duplicateKeyHash> survivors;
+  survivors.reserve(photos.size());
+  for (const auto& photo : photos)
+  {
+    auto inserted = survivors.emplace(duplicateKey{&photo.second}, &photo.first);
+    if (!inserted.second && photoIdLess(photo.first, *inserted.first->second))
+      inserted.first->second = &photo.first;
+  }
+
+  vector<duplicatePhoto> duplicates;
+  if (survivors.size() == photos.size())
+    return duplicates;
+  for (const auto& photo : photos)
+  {
+    const auto& survivorId = *survivors[duplicateKey{&photo.second}];
+    if (survivorId != photo.first)
+      duplicates.push_back({photo.first, survivorId});
+  }
+  return duplicates;
+}
+
+static bool sameDuplicates(const vector<duplicatePhoto>& a, const vector<duplicatePhoto>& b)
+{
+  return a.size() == b.size() && equal(a.begin(), a.end(), b.begin(), [](const duplicatePhoto& x, const duplicatePhoto& y)
+  {
+    return x.photoId == y.photoId && x.survivorId == y.survivorId;
+  });
+}
+
+// Photos as listed with content hashes: increasing 11 digit ids, mostly photos titled by file name
+// or date taken, a few thousand servers, random secrets and hashes. Every 100th photo is a duplicate
+// of the one before.
+static vector<pair<string,photoInfo>> makePhotos(size_t count)
+{
+  mt19937_64 random(1);
+  vector<pair<string,photoInfo>> photos(count);
+  uint64_t photoId = 52000000000;
+  char text[32];
+  for (size_t i = 0; i < count; ++i)
+  {
+    photoId += 1 + random() % 1000;
+    auto& info = photos[i].second;
+    photos[i].first = to_string(photoId);
+    auto minutes = static_cast<unsigned>(i);
+    snprintf(text, sizeof(text), "%04u-%02u-%02u %02u:%02u:%02u", 2000 + minutes / 525600 % 30,
+             1 + minutes / 43200 % 12, 1 + minutes / 1440 % 28, minutes / 60 % 24, minutes % 60, minutes % 7);
+    info.dateTaken = text;
+    if (i % 2)
+      snprintf(text, sizeof(text), "IMG_%07zu", i);
+    else
+      snprintf(text, sizeof(text), "%.4s%.2s%.2s-%.2s%.2s%.2s", info.dateTaken.c_str(), info.dateTaken.c_str() + 5,
+               info.dateTaken.c_str() + 8, info.dateTaken.c_str() + 11, info.dateTaken.c_str() + 14,
+               info.dateTaken.c_str() + 17);
+    info.title = text;
+    info.description = i % 20 ? "" : "Holiday";
+    info.media = i % 50 ? "photo" : "video";
+    info.originalFormat = "jpg";
+    info.server = to_string(65000 + random() % 3000);
+    snprintf(text, sizeof(text), "%010llx", static_cast<unsigned long long>(random() % 0xffffffffffULL));
+    info.originalSecret = text;
+    snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(random()));
+    info.contentHash = text;
+    if (i % 100 == 99)
+    {
+      info.title = photos[i - 1].second.title;
+      info.dateTaken = photos[i - 1].second.dateTaken;
+      info.description = photos[i - 1].second.description;
+    }
+  }
+  return photos;
+}
+
+template <typename Set>
+static result measure(const vector<pair<string,photoInfo>>& photos)
+{
+  result result;
+  auto heapBytes = heapBytesInUse.load();
+  {
+    Set set;
+    auto start = chrono::steady_clock::now();
+    for (const auto& photo : photos)
+      set.add(photo.first, photo.second);
+    result.addSeconds = secondsSince(start);
+    result.bytesPerPhoto = static_cast<double>(heapBytesInUse - heapBytes) / photos.size();
+
+    start = chrono::steady_clock::now();
+    for (const auto& photo : photos)
+      result.found += set.hasPhoto(photo.second.title, photo.second.contentHash);
+    result.lookupSeconds = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    result.duplicates = findDuplicates(set);
+    result.duplicatesSeconds = secondsSince(start);
+  }
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  auto count = argc > 1 ? strtoul(argv[1], nullptr, 10) : DEFAULT_PHOTOS;
+  if (!count)
+  {
+    printf("Usage: %s [number of photos]\n", argv[0]);
+    return 1;
+  }
+
+  auto photos = makePhotos(count);
+  auto reference = measure<ReferencePhotoSet>(photos);
+  auto compact = measure<PhotoSet>(photos);
+
+  printf("%-34s %14s %12s %14s %14s\n", "", "bytes/photo", "add s", "lookup s", "duplicates s");
+  printf("%-34s %14.1f %12.3f %14.3f %14.3f\n", "node map PhotoSet (reference)", reference.bytesPerPhoto,
+         reference.addSeconds, reference.lookupSeconds, reference.duplicatesSeconds);
+  printf("%-34s %14.1f %12.3f %14.3f %14.3f\n", "compact PhotoSet", compact.bytesPerPhoto, compact.addSeconds,
+         compact.lookupSeconds, compact.duplicatesSeconds);
+  printf("%zu photos, %.1fx less memory, %zu duplicates\n", count, reference.bytesPerPhoto / compact.bytesPerPhoto,
+         compact.duplicates.size());
+
+  if (reference.found != count || compact.found != count)
+  {
+    printf("FAILED: photos not found after adding (%zu/%zu)\n", compact.found, reference.found);
+    return 1;
+  }
+  if (!sameDuplicates(reference.duplicates, compact.duplicates))
+  {
+    printf("FAILED: duplicates differ from the reference (%zu/%zu)\n", compact.duplicates.size(),
+           reference.duplicates.size());
+    return 1;
+  }
+  return 0;
+}
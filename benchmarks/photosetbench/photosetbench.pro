@@ -0,0 +1,21 @@
+TEMPLATE = app
+QT -= gui
+CONFIG += console
+CONFIG += c++-11
+CONFIG -= app_bundle
+
+INCLUDEPATH += /usr/include/libxml2
+
+SOURCES += \
+    photosetbench.cpp \
+    ../../duplicates.cpp \
+    ../../photoset.cpp \
+    ../../stringarena.cpp
+
+HEADERS += \
+    ../benchmark.h \
+    ../../duplicates.h \
+    ../../flickrsync.h \
+    ../../indextable.h \
+    ../../photoset.h \
+    ../../stringarena.h
@@ -0,0 +1,171 @@
+#!/bin/sh
+#
+# flickrsync utility - End-to-end sync benchmarks against the mock Flickr server
+#
+# Usage: run-sync-benchmarks.sh [flickrsync binary] [mockflickr binary]
+#
+# Runs the listing, upload, rename (-o), duplicate removal (-f), sort (-s) and download (-d)
+# scenarios for each set size, and prints wall time, API calls and the time of each sync phase
+# as recorded by --stats. Environment variables:
+#
+#   SIZES       photos per set (default "1000 10000 100000")
+#   LATENCY_MS  delay of each API call and upload in the mock server (default 5)
+#   JOBS        flickrsync -j (default 8)
+#   PORT        port of the mock server (default 8089)
+#   KEEP        keep the work directory with logs and stats files when set
+#
+
+set -e
+
+BENCHMARKS=$(cd "$(dirname "$0")" && pwd)
+FLICKRSYNC=${1:-$BENCHMARKS/../flickrsync}
+MOCKFLICKR=${2:-$BENCHMARKS/mockflickr/mockflickr}
+SIZES=${SIZES:-"1000 10000 100000"}
+LATENCY_MS=${LATENCY_MS:-5}
+JOBS=${JOBS:-8}
+PORT=${PORT:-8089}
+SET_NAME=bench
+
+for binary in "$FLICKRSYNC" "$MOCKFLICKR"; do
+  if [ ! -x "$binary" ]; then
+    echo "ERROR: $binary not found, build flickrsync.pro and benchmarks/benchmarks.pro first" >&2
+    exit 1
+  fi
+done
+
+WORK=$(mktemp -d)
+MOCK_PID=
+
+cleanup() {
+  stop_mock
+  if [ -z "$KEEP" ]; then
+    rm -rf "$WORK"
+  else
+    echo "Logs and stats files are in $WORK"
+  fi
+}
+trap cleanup EXIT
+
+# flickcurl only needs some credentials, the mock server does not check the signatures
+export HOME="$WORK/home"
+mkdir -p "$HOME"
+cat > "$HOME/.flickcurl.conf" <<EOF
+[flickr]
+api_key=benchmark
+secret=benchmark
+oauth_client_key=benchmark
+oauth_client_secret=benchmark
+oauth_token=benchmark
+oauth_token_secret=benchmark
+EOF
+
+export FLICKRSYNC_API_URI="http://127.0.0.1:$PORT/services/rest/"
+export FLICKRSYNC_UPLOAD_URI="http://127.0.0.1:$PORT/services/upload/"
+export FLICKRSYNC_PHOTO_SOURCE_URL="http://127.0.0.1:$PORT/photos/"
+
+start_mock() {
+  "$MOCKFLICKR" --port "$PORT" --latency-ms "$LATENCY_MS" "$@" > "$WORK/mockflickr.log" 2>&1 &
+  MOCK_PID=$!
+  for attempt in $(seq 100); do
+    if grep -q "listening" "$WORK/mockflickr.log"; then
+      return
+    fi
+    if ! kill -0 "$MOCK_PID" 2> /dev/null; then
+      cat "$WORK/mockflickr.log" >&2
+      exit 1
+    fi
+    sleep 0.1
+  done
+  echo "ERROR: mock Flickr server did not start" >&2
+  exit 1
+}
+
+stop_mock() {
+  if [ -n "$MOCK_PID" ]; then
+    kill "$MOCK_PID" 2> /dev/null || true
+    wait "$MOCK_PID" 2> /dev/null || true
+    MOCK_PID=
+  fi
+}
+
+# Folder named after the set, with files img-{first}.jpg..img-{last}.jpg of a few bytes each
+make_folder() {
+  folder="$WORK/sync/$SET_NAME"
+  rm -rf "$WORK/sync"
+  mkdir -p "$folder"
+  if [ "$1" -le "$2" ]; then
+    seq -f "$folder/img-%06g.jpg" "$1" "$2" | xargs sh -c 'for file; do printf "%s" "$file" > "$file"; done' sh
+  fi
+}
+
+# Prints "name=seconds" for each phase in the phases object of --stats file
+phase_times() {
+  sed -n '/"phases"/,/"endpoints"/s/^ *"\([^"]*\)": {"count": [0-9]*, "seconds": \([0-9.]*\)}.*/\1=\2/p' "$1" |
+    awk -F= '{ printf "%s=%.2fs ", $1, $2 }'
+}
+
+api_calls() {
+  sed -n '/"endpoints"/,$s/.*"calls": \([0-9]*\).*/\1/p' "$1" | awk '{ calls += $1 } END { print calls + 0 }'
+}
+
+# run {scenario} {size} {flickrsync options...}
+run() {
+  scenario=$1
+  size=$2
+  shift 2
+  stats="$WORK/$scenario-$size.json"
+  log="$WORK/$scenario-$size.log"
+  start=$(date +%s%N)
+  status=ok
+  "$FLICKRSYNC" -F -B 1000000000 -j "$JOBS" -S "$stats" "$@" "$WORK/sync/$SET_NAME" > "$log" 2>&1 || status=failed
+  end=$(date +%s%N)
+  wall=$(awk -v start="$start" -v end="$end" 'BEGIN { printf "%.2f", (end - start) / 1e9 }')
+  if [ -f "$stats" ]; then
+    printf "%-10s %7s %8ss %8s calls  %s %s\n" "$scenario" "$size" "$wall" "$(api_calls "$stats")" \
+           "$(phase_times "$stats")" "$([ $status = ok ] || echo "(flickrsync failed, see $log)")"
+  else
+    printf "%-10s %7s %8ss  flickrsync failed, see %s\n" "$scenario" "$size" "$wall" "$log"
+  fi
+}
+
+echo "Mock Flickr latency ${LATENCY_MS} ms per API call, flickrsync -j $JOBS"
+printf "%-10s %7s %9s %14s  %s\n" scenario photos wall "API calls" "phases"
+for size in $SIZES; do
+  uploads=$((size / 10))
+
+  # Folder and set are in sync, the set is listed and compared
+  start_mock --set "$SET_NAME:$size"
+  make_folder 1 "$size"
+  run listing "$size"
+  stop_mock
+
+  # A tenth of the folder is new and gets uploaded
+  start_mock --set "$SET_NAME:$size"
+  make_folder 1 $((size + uploads))
+  run upload "$size"
+  stop_mock
+
+  # Every photo is titled by date taken, the empty folder leaves nothing to upload
+  start_mock --set "$SET_NAME:$size"
+  make_folder 1 0
+  run rename "$size" -o
+  stop_mock
+
+  # A tenth of the photos have an identical copy in the set
+  start_mock --set "$SET_NAME:$size" --duplicates 10
+  make_folder 1 "$size"
+  run duplicates "$size" -f
+  stop_mock
+
+  # Set is in random order
+  start_mock --set "$SET_NAME:$size" --shuffle
+  make_folder 1 "$size"
+  run sort "$size" -s
+  stop_mock
+
+  # Whole set is downloaded into an empty folder
+  start_mock --set "$SET_NAME:$size"
+  make_folder 1 0
+  run download "$size" -d
+  stop_mock
+done
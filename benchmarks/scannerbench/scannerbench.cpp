@@ -0,0 +1,156 @@
+/*
+ *
+ * flickrsync utility - Benchmark of the folder scanner against QDir
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <QDir>
+#include <QFileInfo>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../benchmark.h"
+#include "../../scanner.h"
+
+using namespace std;
+
+const size_t DEFAULT_FILES{200000};
+const unsigned RUNS{5};
+// Entries that both listings skip: sub folders and hidden files
+const unsigned SKIPPED_FOLDERS{10};
+const unsigned SKIPPED_HIDDEN_FILES{10};
+
+static string numberedName(const char* format, size_t number)
+{
+  char name[64];
+  snprintf(name, sizeof(name), format, number);
+  return name;
+}
+
+static bool createFile(const string& filePath)
+{
+  auto fd = open(filePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return false;
+  close(fd);
+  return true;
+}
+
+// Folder with count photos and some sub folders, hidden files and symlinks to photos
+static bool createTree(const string& folderPath, size_t count)
+{
+  for (size_t i = 0; i < count; ++i)
+  {
+    auto filePath = folderPath + '/' + numberedName("IMG_%07zu.JPG", i);
+    if (i % 1000 == 999 ? symlink(numberedName("IMG_%07zu.JPG", i - 1).c_str(), filePath.c_str()) != 0 :
+        !createFile(filePath))
+    {
+      printf("ERROR: Unable to create %s: %s\n", filePath.c_str(), strerror(errno));
+      return false;
+    }
+  }
+  for (unsigned i = 0; i < SKIPPED_FOLDERS; ++i)
+    mkdir((folderPath + '/' + numberedName("folder-%zu", i)).c_str(), 0755);
+  for (unsigned i = 0; i < SKIPPED_HIDDEN_FILES; ++i)
+    createFile(folderPath + '/' + numberedName(".hidden-%zu", i));
+  return true;
+}
+
+static void removeTree(const string& folderPath, size_t count)
+{
+  for (size_t i = 0; i < count; ++i)
+    unlink((folderPath + '/' + numberedName("IMG_%07zu.JPG", i)).c_str());
+  for (unsigned i = 0; i < SKIPPED_FOLDERS; ++i)
+    rmdir((folderPath + '/' + numberedName("folder-%zu", i)).c_str());
+  for (unsigned i = 0; i < SKIPPED_HIDDEN_FILES; ++i)
+    unlink((folderPath + '/' + numberedName(".hidden-%zu", i)).c_str());
+  rmdir(folderPath.c_str());
+}
+
+// Listing as done before the scanner
+static vector<string> listWithQDir(const string& folderPath)
+{
+  vector<string> fileNames;
+  for (const auto& entry : QDir(QString::fromStdString(folderPath)).entryInfoList())
+    if (entry.isFile())
+      fileNames.push_back(entry.fileName().toStdString());
+  return fileNames;
+}
+
+static vector<string> listWithScanner(const string& folderPath)
+{
+  vector<string> fileNames;
+  scanFolder(folderPath, [&fileNames](const char* fileName) { fileNames.emplace_back(fileName); });
+  return fileNames;
+}
+
+// Fastest of the runs, after a first run warming the directory and inode caches
+template <typename List>
+static double bestSeconds(const string& folderPath, const List& list, vector<string>* fileNames)
+{
+  *fileNames = list(folderPath);
+  auto best = 0.0;
+  for (unsigned run = 0; run < RUNS; ++run)
+  {
+    auto start = chrono::steady_clock::now();
+    auto listed = list(folderPath);
+    auto seconds = secondsSince(start);
+    if (!run || seconds < best)
+      best = seconds;
+  }
+  return best;
+}
+
+int main(int argc, char* argv[])
+{
+  auto count = argc > 1 ? strtoul(argv[1], nullptr, 10) : DEFAULT_FILES;
+  if (!count)
+  {
+    printf("Usage: %s [number of files] [parent folder of the generated tree]\n", argv[0]);
+    return 1;
+  }
+
+  auto folderTemplate = string(argc > 2 ? argv[2] : "/tmp") + "/scannerbench-XXXXXX";
+  if (!mkdtemp(&folderTemplate[0]))
+  {
+    printf("ERROR: Unable to create folder %s: %s\n", folderTemplate.c_str(), strerror(errno));
+    return 1;
+  }
+  auto folderPath = folderTemplate;
+  printf("Creating %zu files in %s...\n", count, folderPath.c_str());
+  if (!createTree(folderPath, count))
+  {
+    removeTree(folderPath, count);
+    return 1;
+  }
+
+  vector<string> qdirFiles, scannerFiles;
+  auto qdirSeconds = bestSeconds(folderPath, listWithQDir, &qdirFiles);
+  auto scannerSeconds = bestSeconds(folderPath, listWithScanner, &scannerFiles);
+  removeTree(folderPath, count);
+
+  printf("%-30s %10s %14s\n", "", "seconds", "files/second");
+  printf("%-30s %10.3f %14.0f\n", "QDir::entryInfoList", qdirSeconds, count / max(qdirSeconds, 1e-9));
+  printf("%-30s %10.3f %14.0f\n", "scanFolder (getdents64/statx)", scannerSeconds,
+         count / max(scannerSeconds, 1e-9));
+  printf("%zu files, best of %u runs, speedup %.1fx\n", count, RUNS, qdirSeconds / max(scannerSeconds, 1e-9));
+
+  sort(qdirFiles.begin(), qdirFiles.end());
+  sort(scannerFiles.begin(), scannerFiles.end());
+  if (qdirFiles != scannerFiles || scannerFiles.size() != count)
+  {
+    printf("FAILED: listings differ (QDir %zu files, scanner %zu files)\n", qdirFiles.size(), scannerFiles.size());
+    return 1;
+  }
+  return 0;
+}
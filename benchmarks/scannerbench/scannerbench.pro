@@ -0,0 +1,13 @@
+TEMPLATE = app
+QT -= gui
+CONFIG += console
+CONFIG += c++-11
+CONFIG -= app_bundle
+
+SOURCES += \
+    scannerbench.cpp \
+    ../../scanner.cpp
+
+HEADERS += \
+    ../benchmark.h \
+    ../../scanner.h
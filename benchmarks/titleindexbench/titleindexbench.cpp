@@ -0,0 +1,217 @@
+/*
+ *
+ * flickrsync utility - Microbenchmark of planning renames and uploads with the title index of PhotoSet
+ *
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../benchmark.h"
+#include "../../photoset.h"
+
+using namespace std;
+
+const vector<size_t> DEFAULT_SET_SIZES{1000, 10000, 100000};
+// Reference scans the whole set for every title, so it is only run up to this size
+const size_t REFERENCE_MAX_PHOTOS{10000};
+// Photos taken in the same second, their titles need a -n suffix
+const size_t BURST_LENGTH{4};
+// Planning time grows as n^exponent with the set size, 1 for linear and 2 for the reference
+const double MAX_SCALING_EXPONENT{1.5};
+
+// Reference implementation, as in flickrsync.cpp before the title index
+bool titleExistingInSet(const map<string,photoInfo>& photos, const string& title)
+{
+  for (const auto& photo : photos)
+    if (photo.second.title == title)
+      return true;
+  return false;
+}
+
+string addSuffixWhenDuplicateNamesExist(const string& title, const map<string,photoInfo>& photos)
+{
+  string correctedTitle = title;
+  int prefix = 0;
+  while (titleExistingInSet(photos, correctedTitle))
+    correctedTitle = title + "-" + to_string(++prefix);
+  return correctedTitle;
+}
+
+namespace {
+
+struct workload {
+  // Photo id => title of the photos in set
+  vector<pair<string,string>> photosInSet;
+  // Photo id => date based title of the photos in set that are titled by file name
+  vector<pair<string,string>> photosToRename;
+  // Titles of the files in folder
+  vector<string> filesInFolder;
+};
+
+struct result {
+  size_t uploads{0};
+  double seconds{0};
+};
+
+}
+
+static string dateBasedTitle(size_t second, size_t burstIndex)
+{
+  char title[32];
+  snprintf(title, sizeof(title), "%04zu%02zu%02zu-%02zu%02zu%02zu", 2000 + second / 31104000, 1 + second / 2592000 % 12,
+           1 + second / 86400 % 30, second / 3600 % 24, second / 60 % 60, second % 60);
+  return burstIndex ? title + ("-" + to_string(burstIndex)) : title;
+}
+
+// Set of photos titled by date taken, in bursts of photos taken in the same second (at even seconds). The last
+// photo of each burst is still titled by file name, so renaming it needs the next free suffix. Half of the folder
+// is in the set already, the other half is new.
+static workload makeWorkload(size_t count)
+{
+  workload workload;
+  for (size_t i = 0; i < count; ++i)
+  {
+    auto photoId = to_string(52000000000 + i);
+    auto second = i / BURST_LENGTH * 2;
+    if (i % BURST_LENGTH == BURST_LENGTH - 1)
+    {
+      char fileName[32];
+      snprintf(fileName, sizeof(fileName), "IMG_%07zu", i);
+      workload.photosInSet.emplace_back(photoId, fileName);
+      workload.photosToRename.emplace_back(photoId, dateBasedTitle(second, 0));
+    }
+    else
+      workload.photosInSet.emplace_back(photoId, dateBasedTitle(second, i % BURST_LENGTH));
+    if (i % 2 == 0)
+      workload.filesInFolder.push_back(workload.photosInSet.back().second);
+    else
+      workload.filesInFolder.push_back(dateBasedTitle(second + 1, i % BURST_LENGTH));
+  }
+  return workload;
+}
+
+// Renames photos to their date based title and uploads the files that are not in set yet
+static result planWithPhotoSet(const workload& workload)
+{
+  PhotoSet photos;
+  for (const auto& photo : workload.photosInSet)
+  {
+    photoInfo info;
+    info.title = photo.second;
+    photos.add(photo.first, info);
+  }
+
+  result result;
+  auto start = chrono::steady_clock::now();
+  for (const auto& photo : workload.photosToRename)
+    photos.setTitle(photo.first, photos.uniqueTitle(photo.second));
+  for (const auto& title : workload.filesInFolder)
+    if (!photos.hasPhoto(title, ""))
+    {
+      photoInfo info;
+      info.title = photos.uniqueTitle(title);
+      photos.add("-" + info.title, info);
+      ++result.uploads;
+    }
+  result.seconds = secondsSince(start);
+  return result;
+}
+
+static result planWithReference(const workload& workload)
+{
+  map<string,photoInfo> photos;
+  for (const auto& photo : workload.photosInSet)
+    photos[photo.first].title = photo.second;
+
+  result result;
+  auto start = chrono::steady_clock::now();
+  for (const auto& photo : workload.photosToRename)
+    photos[photo.first].title = addSuffixWhenDuplicateNamesExist(photo.second, photos);
+  for (const auto& title : workload.filesInFolder)
+    if (!titleExistingInSet(photos, title))
+    {
+      photoInfo info;
+      info.title = addSuffixWhenDuplicateNamesExist(title, photos);
+      photos["-" + info.title] = info;
+      ++result.uploads;
+    }
+  result.seconds = secondsSince(start);
+  return result;
+}
+
+static double scalingExponent(size_t previousSize, double previousSeconds, size_t size, double seconds)
+{
+  return log(seconds / previousSeconds) / log(static_cast<double>(size) / previousSize);
+}
+
+// Growth of planning time from the previous set size, as n^exponent
+static string growth(size_t previousSize, double previousSeconds, size_t size, double seconds)
+{
+  if (!previousSize || previousSeconds <= 0 || size == previousSize)
+    return "";
+  char text[32];
+  snprintf(text, sizeof(text), "n^%.2f", scalingExponent(previousSize, previousSeconds, size, seconds));
+  return text;
+}
+
+int main(int argc, char* argv[])
+{
+  auto setSizes = DEFAULT_SET_SIZES;
+  if (argc > 1)
+  {
+    setSizes.clear();
+    for (int i = 1; i < argc; ++i)
+      if (auto size = strtoul(argv[i], nullptr, 10))
+        setSizes.push_back(size);
+      else
+      {
+        printf("Usage: %s [photos in set]...\n", argv[0]);
+        return 1;
+      }
+  }
+
+  printf("%12s %12s %10s %12s %10s %14s %10s\n", "photos", "uploads", "seconds", "ns/photo", "growth",
+         "reference s", "growth");
+  auto failed = false, superlinear = false;
+  size_t previousSize{0};
+  double previousSeconds{0}, previousReferenceSeconds{0};
+  for (auto size : setSizes)
+  {
+    auto workload = makeWorkload(size);
+    auto planned = planWithPhotoSet(workload);
+    printf("%12zu %12zu %10.4f %12.1f %10s", size, planned.uploads, planned.seconds, planned.seconds * 1e9 / size,
+           growth(previousSize, previousSeconds, size, planned.seconds).c_str());
+    if (previousSize && scalingExponent(previousSize, previousSeconds, size, planned.seconds) > MAX_SCALING_EXPONENT)
+      superlinear = true;
+
+    auto referenceSeconds = 0.0;
+    if (size <= REFERENCE_MAX_PHOTOS)
+    {
+      auto reference = planWithReference(workload);
+      referenceSeconds = reference.seconds;
+      printf(" %14.4f %10s\n", reference.seconds,
+             growth(previousSize, previousReferenceSeconds, size, reference.seconds).c_str());
+      if (reference.uploads != planned.uploads)
+      {
+        printf("FAILED: reference plans %zu uploads\n", reference.uploads);
+        failed = true;
+      }
+    }
+    else
+      printf(" %14s %10s\n", "-", "-");
+
+    previousSize = size;
+    previousSeconds = planned.seconds;
+    previousReferenceSeconds = referenceSeconds;
+  }
+
+  if (superlinear)
+    printf("FAILED: planning time grows faster than n^%.1f with the set size\n", MAX_SCALING_EXPONENT);
+  return failed || superlinear ? 1 : 0;
+}
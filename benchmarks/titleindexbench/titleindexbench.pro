@@ -0,0 +1,19 @@
+TEMPLATE = app
+QT -= gui
+CONFIG += console
+CONFIG += c++-11
+CONFIG -= app_bundle
+
+INCLUDEPATH += /usr/include/libxml2
+
+SOURCES += \
+    titleindexbench.cpp \
+    ../../photoset.cpp \
+    ../../stringarena.cpp
+
+HEADERS += \
+    ../benchmark.h \
+    ../../flickrsync.h \
+    ../../indextable.h \
+    ../../photoset.h \
+    ../../stringarena.h
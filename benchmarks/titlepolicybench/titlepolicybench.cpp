@@ -0,0 +1,149 @@
+/*
+ *
+ * flickrsync utility - Microbenchmark of the date based title policy
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <QRegularExpression>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../benchmark.h"
+#include "../../titlepolicy.h"
+
+using namespace std;
+
+const size_t DEFAULT_TITLES{1000000};
+const double REQUIRED_SPEEDUP{10};
+
+// Reference implementation, as in flickrsync.cpp before the title policy
+bool isDateBasedName(const string& title)
+{
+  // Try to match YYYYMMDD-HHMMSS-n..
+  return QRegularExpression("^\\d\\d\\d\\d\\d\\d\\d\\d-\\d\\d\\d\\d\\d\\d(-\\d*)?$").match(
+        QString::fromStdString(title), 0, QRegularExpression::PartialPreferCompleteMatch).hasMatch();
+}
+
+string correctNameBasedOnDateTaken(const string& dateTaken)
+{
+  if (dateTaken.length() < 19) // date_taken is in format YYYY-MM-DD HH:MM:SS
+    return "";
+  return dateTaken.substr(0, 4) + dateTaken.substr(5, 2) + dateTaken.substr(8, 2) + "-" +
+      dateTaken.substr(11, 2) + dateTaken.substr(14, 2) + dateTaken.substr(17, 2);
+}
+
+namespace {
+
+struct photo {
+  string title;
+  string dateTaken;
+};
+
+struct result {
+  size_t dateBased{0};
+  size_t titleBytes{0};
+  double seconds{0};
+  unsigned long long allocations{0};
+};
+
+}
+
+// Photos as listed from Flickr: half titled by date taken (some with a -n suffix), the rest by file name
+static vector<photo> makePhotos(size_t count)
+{
+  vector<photo> photos(count);
+  char text[32];
+  for (size_t i = 0; i < count; ++i)
+  {
+    auto minutes = static_cast<unsigned>(i);
+    snprintf(text, sizeof(text), "%04u-%02u-%02u %02u:%02u:%02u", 2000 + minutes / 525600 % 30,
+             1 + minutes / 43200 % 12, 1 + minutes / 1440 % 28, minutes / 60 % 24, minutes % 60, minutes % 7);
+    photos[i].dateTaken = text;
+    if (i % 2 == 0)
+      photos[i].title = titlePolicy.titleFor(photos[i].dateTaken) + (i % 10 == 0 ? "-1" : "");
+    else
+    {
+      snprintf(text, sizeof(text), i % 3 ? "IMG_%06zu" : "2019%04zu-holiday", i);
+      photos[i].title = text;
+    }
+  }
+  return photos;
+}
+
+static result runReference(const vector<photo>& photos)
+{
+  result result;
+  auto allocations = allocationCount.load();
+  auto start = chrono::steady_clock::now();
+  for (const auto& photo : photos)
+    if (isDateBasedName(photo.title))
+      ++result.dateBased;
+    else
+      result.titleBytes += correctNameBasedOnDateTaken(photo.dateTaken).size();
+  result.seconds = secondsSince(start);
+  result.allocations = allocationCount - allocations;
+  return result;
+}
+
+static result runTitlePolicy(const vector<photo>& photos)
+{
+  result result;
+  string title;
+  title.reserve(64);
+  auto allocations = allocationCount.load();
+  auto start = chrono::steady_clock::now();
+  for (const auto& photo : photos)
+    if (titlePolicy.matches(photo.title))
+      ++result.dateBased;
+    else if (titlePolicy.titleFor(photo.dateTaken, &title))
+      result.titleBytes += title.size();
+  result.seconds = secondsSince(start);
+  result.allocations = allocationCount - allocations;
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  auto count = argc > 1 ? strtoul(argv[1], nullptr, 10) : DEFAULT_TITLES;
+  if (!count)
+  {
+    printf("Usage: %s [number of titles]\n", argv[0]);
+    return 1;
+  }
+
+  auto photos = makePhotos(count);
+  auto reference = runReference(photos);
+  auto policy = runTitlePolicy(photos);
+  auto speedup = reference.seconds / max(policy.seconds, 1e-9);
+
+  printf("%-34s %10s %14s %14s\n", "", "seconds", "ns/title", "allocations");
+  printf("%-34s %10.3f %14.1f %14llu\n", "QRegularExpression (reference)", reference.seconds,
+         reference.seconds * 1e9 / count, reference.allocations);
+  printf("%-34s %10.3f %14.1f %14llu\n", "TitlePolicy", policy.seconds, policy.seconds * 1e9 / count,
+         policy.allocations);
+  printf("%zu titles, %zu date based, speedup %.1fx\n", count, policy.dateBased, speedup);
+
+  auto failed = false;
+  if (policy.dateBased != reference.dateBased || policy.titleBytes != reference.titleBytes)
+  {
+    printf("FAILED: results differ from the reference (%zu/%zu date based, %zu/%zu title bytes)\n",
+           policy.dateBased, reference.dateBased, policy.titleBytes, reference.titleBytes);
+    failed = true;
+  }
+  if (policy.allocations)
+  {
+    printf("FAILED: title policy allocated memory %llu times\n", policy.allocations);
+    failed = true;
+  }
+  if (speedup < REQUIRED_SPEEDUP)
+  {
+    printf("FAILED: title policy is less than %.0fx faster than the reference\n", REQUIRED_SPEEDUP);
+    failed = true;
+  }
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,13 @@
+TEMPLATE = app
+QT -= gui
+CONFIG += console
+CONFIG += c++-11
+CONFIG -= app_bundle
+
+SOURCES += \
+    titlepolicybench.cpp \
+    ../../titlepolicy.cpp
+
+HEADERS += \
+    ../benchmark.h \
+    ../../titlepolicy.h
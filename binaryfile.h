@@ -0,0 +1,117 @@
+/*
+ *
+ * flickrsync utility - Binary file reading and writing for manifest and plan files
+ *
+ */
+
+#ifndef BINARYFILE_H
+#define BINARYFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include <string>
+
+#include "flickrsync.h"
+
+// Smallest sizes of stored values, an empty string is only its length prefix
+const size_t STRING_MIN_BYTES{sizeof(uint32_t)};
+const size_t PHOTO_INFO_MIN_BYTES{8 * STRING_MIN_BYTES};
+
+// Writes values in host byte order and strings with 32-bit length prefix, ok turns false on first error
+class BinaryWriter
+{
+public:
+  explicit BinaryWriter(FILE* file) : file(file) {}
+
+  template <typename T>
+  void write(T value) { ok = ok && fwrite(&value, sizeof(value), 1, file) == 1; }
+
+  void write(const std::string& value)
+  {
+    write(static_cast<uint32_t>(value.size()));
+    ok = ok && (value.empty() || fwrite(value.data(), value.size(), 1, file) == 1);
+  }
+
+  void write(const photoInfo& info)
+  {
+    write(info.title);
+    write(info.dateTaken);
+    write(info.description);
+    write(info.media);
+    write(info.originalFormat);
+    write(info.server);
+    write(info.originalSecret);
+    write(info.contentHash);
+  }
+
+  bool ok{true};
+
+private:
+  FILE* file;
+};
+
+// Reads values written by BinaryWriter, ok turns false on first error. Lengths and counts are checked
+// against the bytes left in the file, so a corrupted file does not make huge allocations.
+class BinaryReader
+{
+public:
+  explicit BinaryReader(FILE* file) : file(file)
+  {
+    struct stat status;
+    fileSize = fstat(fileno(file), &status) == 0 ? status.st_size : 0;
+  }
+
+  template <typename T>
+  T read()
+  {
+    T value{};
+    ok = ok && fread(&value, sizeof(value), 1, file) == 1;
+    return value;
+  }
+
+  std::string readString()
+  {
+    auto size = read<uint32_t>();
+    std::string value;
+    if (ok && size && !fits(size, 1))
+      return value;
+    if (ok && size)
+    {
+      value.resize(size);
+      ok = fread(&value[0], size, 1, file) == 1;
+    }
+    return value;
+  }
+
+  photoInfo readPhotoInfo()
+  {
+    photoInfo info;
+    info.title = readString();
+    info.dateTaken = readString();
+    info.description = readString();
+    info.media = readString();
+    info.originalFormat = readString();
+    info.server = readString();
+    info.originalSecret = readString();
+    info.contentHash = readString();
+    return info;
+  }
+
+  // Checks that count values of at least minBytesEach bytes can be left in the file
+  bool fits(uint64_t count, size_t minBytesEach)
+  {
+    auto position = ftello(file);
+    ok = ok && position >= 0 && position <= fileSize && count * minBytesEach <= static_cast<uint64_t>(fileSize - position);
+    return ok;
+  }
+
+  bool ok{true};
+
+private:
+  FILE* file;
+  off_t fileSize;
+};
+
+#endif // BINARYFILE_H
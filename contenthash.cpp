@@ -0,0 +1,183 @@
+/*
+ *
+ * flickrsync utility - Content hashing of local photo/video files
+ *
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <thread>
+#include <unordered_map>
+
+#include "contenthash.h"
+#include "workqueue.h"
+
+using namespace std;
+
+const char* CONTENT_HASH_MACHINE_TAG{"flickrsync:xxh64="};
+
+const uint64_t PRIME64_1{0x9E3779B185EBCA87ULL};
+const uint64_t PRIME64_2{0xC2B2AE3D27D4EB4FULL};
+const uint64_t PRIME64_3{0x165667B19E3779F9ULL};
+const uint64_t PRIME64_4{0x85EBCA77C2B2AE63ULL};
+const uint64_t PRIME64_5{0x27D4EB2F165667C5ULL};
+
+static inline uint64_t rotateLeft(uint64_t value, int bits)
+{
+  return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t read64(const uint8_t* data)
+{
+  uint64_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+static inline uint32_t read32(const uint8_t* data)
+{
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+static inline uint64_t xxh64Round(uint64_t accumulator, uint64_t input)
+{
+  accumulator += input * PRIME64_2;
+  accumulator = rotateLeft(accumulator, 31);
+  return accumulator * PRIME64_1;
+}
+
+static inline uint64_t xxh64MergeRound(uint64_t accumulator, uint64_t value)
+{
+  accumulator ^= xxh64Round(0, value);
+  return accumulator * PRIME64_1 + PRIME64_4;
+}
+
+// XXH64 as specified by xxHash, input is read in little endian byte order of x86/ARM hosts
+uint64_t xxh64(const void* data, size_t length, uint64_t seed)
+{
+  auto input = static_cast<const uint8_t*>(data);
+  auto end = input + length;
+  uint64_t hash;
+
+  if (length >= 32)
+  {
+    auto limit = end - 32;
+    uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+    uint64_t v2 = seed + PRIME64_2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - PRIME64_1;
+    do
+    {
+      v1 = xxh64Round(v1, read64(input));
+      v2 = xxh64Round(v2, read64(input + 8));
+      v3 = xxh64Round(v3, read64(input + 16));
+      v4 = xxh64Round(v4, read64(input + 24));
+      input += 32;
+    }
+    while (input <= limit);
+
+    hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+    hash = xxh64MergeRound(hash, v1);
+    hash = xxh64MergeRound(hash, v2);
+    hash = xxh64MergeRound(hash, v3);
+    hash = xxh64MergeRound(hash, v4);
+  }
+  else
+    hash = seed + PRIME64_5;
+
+  hash += length;
+
+  while (input + 8 <= end)
+  {
+    hash ^= xxh64Round(0, read64(input));
+    hash = rotateLeft(hash, 27) * PRIME64_1 + PRIME64_4;
+    input += 8;
+  }
+  if (input + 4 <= end)
+  {
+    hash ^= static_cast<uint64_t>(read32(input)) * PRIME64_1;
+    hash = rotateLeft(hash, 23) * PRIME64_2 + PRIME64_3;
+    input += 4;
+  }
+  while (input < end)
+  {
+    hash ^= *input * PRIME64_5;
+    hash = rotateLeft(hash, 11) * PRIME64_1;
+    ++input;
+  }
+
+  hash ^= hash >> 33;
+  hash *= PRIME64_2;
+  hash ^= hash >> 29;
+  hash *= PRIME64_3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+string contentHash(int fd, size_t size)
+{
+  uint64_t hash;
+  if (size)
+  {
+    auto data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+      return "";
+    madvise(data, size, MADV_SEQUENTIAL);
+    hash = xxh64(data, size, 0);
+    munmap(data, size);
+  }
+  else
+    hash = xxh64(nullptr, 0, 0);
+
+  char hex[17];
+  snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+  return hex;
+}
+
+void hashFiles(const string& folderPath, vector<localFile>* files, const vector<localFile>& cache)
+{
+  unordered_map<string,const localFile*> cachedFiles;
+  for (const auto& file : cache)
+    if (!file.contentHash.empty())
+      cachedFiles[file.fileName] = &file;
+
+  runConcurrently(files->size(), max(1u, thread::hardware_concurrency()), [&](unsigned, size_t i)
+  {
+    auto& file = (*files)[i];
+    file.contentHash.clear();
+    auto fd = open((folderPath + '/' + file.fileName).c_str(), O_RDONLY);
+    if (fd < 0)
+      return;
+
+    struct stat status;
+    if (!fstat(fd, &status))
+    {
+      file.inode = status.st_ino;
+      file.size = status.st_size;
+      file.mtime = static_cast<int64_t>(status.st_mtim.tv_sec) * 1000 + status.st_mtim.tv_nsec / 1000000;
+
+      auto cached = cachedFiles.find(file.fileName);
+      if (cached != cachedFiles.end() && cached->second->inode == file.inode &&
+          cached->second->size == file.size && cached->second->mtime == file.mtime)
+        file.contentHash = cached->second->contentHash;
+      else
+        file.contentHash = contentHash(fd, file.size);
+    }
+    close(fd);
+  });
+}
+
+string contentHashFromTag(const char* tag)
+{
+  auto prefixLength = strlen(CONTENT_HASH_MACHINE_TAG);
+  if (tag && strncmp(tag, CONTENT_HASH_MACHINE_TAG, prefixLength) == 0)
+    return tag + prefixLength;
+  return "";
+}
@@ -0,0 +1,33 @@
+/*
+ *
+ * flickrsync utility - Content hashing of local photo/video files
+ *
+ */
+
+#ifndef CONTENTHASH_H
+#define CONTENTHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "manifest.h"
+
+// Machine tag used to store the content hash of uploaded photos/videos on Flickr
+extern const char* CONTENT_HASH_MACHINE_TAG;
+
+uint64_t xxh64(const void* data, size_t length, uint64_t seed);
+
+// Returns content hash of the file as hex string, empty when the file can not be read
+std::string contentHash(int fd, size_t size);
+
+// Sets contentHash (and inode, size, mtime) of files in folder, hashing them in parallel.
+// Hashes are reused from cache for files with unchanged inode, size and mtime.
+void hashFiles(const std::string& folderPath, std::vector<localFile>* files, const std::vector<localFile>& cache);
+
+// Returns content hash stored in machine tag, empty when tag is not a content hash tag
+std::string contentHashFromTag(const char* tag);
+
+#endif // CONTENTHASH_H
@@ -0,0 +1,358 @@
+/*
+ *
+ * flickrsync utility - Parallel download engine
+ *
+ */
+
+#include <fcntl.h>
+#include <glob.h>
+#include <libgen.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#include "downloader.h"
+#include "stats.h"
+
+using namespace std;
+
+const string PARTIAL_DOWNLOAD_SUFFIX{".part"};
+
+namespace {
+
+// Bandwidth cap and byte budget shared by all downloaders of the run. The cap delays the write
+// callback until the received bytes fit the rate, curl then stops reading from the connection.
+struct downloadLimits {
+  int64_t maxBytesPerSecond{0};
+  bool budgeted{false};
+  atomic<int64_t> bytesLeft{0};
+  atomic<bool> budgetReported{false};
+
+  std::mutex rateMutex;
+  chrono::steady_clock::time_point nextWrite;
+};
+
+downloadLimits limits;
+
+}
+
+void setDownloadLimits(int64_t maxBytesPerSecond, int64_t maxBytes)
+{
+  limits.maxBytesPerSecond = maxBytesPerSecond;
+  limits.budgeted = maxBytes > 0;
+  limits.bytesLeft = maxBytes;
+}
+
+static bool budgetExhausted()
+{
+  if (!limits.budgeted || limits.bytesLeft > 0)
+    return false;
+  if (!limits.budgetReported.exchange(true))
+    printf("Download budget used up, remaining downloads are left for the next run\n");
+  return true;
+}
+
+// Bytes of length allowed by the budget
+static size_t takeBudget(size_t length)
+{
+  if (!limits.budgeted)
+    return length;
+  auto left = limits.bytesLeft.load();
+  int64_t taken;
+  do
+    taken = min<int64_t>(left, length);
+  while (taken > 0 && !limits.bytesLeft.compare_exchange_weak(left, left - taken));
+  return taken > 0 ? taken : 0;
+}
+
+static void throttle(size_t length)
+{
+  if (limits.maxBytesPerSecond <= 0)
+    return;
+  chrono::steady_clock::time_point writeAt;
+  {
+    lock_guard<std::mutex> lock(limits.rateMutex);
+    writeAt = max(limits.nextWrite, chrono::steady_clock::now());
+    limits.nextWrite = writeAt + chrono::microseconds(static_cast<int64_t>(length) * 1000000 / limits.maxBytesPerSecond);
+  }
+  this_thread::sleep_until(writeAt);
+}
+
+static string partialFileName(const string& fileName, const string& url)
+{
+  // 64-bit FNV-1a hash of the URL
+  uint64_t hash = 14695981039346656037ull;
+  for (auto c : url)
+  {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ull;
+  }
+  char key[17];
+  snprintf(key, sizeof(key), "%016llx", static_cast<unsigned long long>(hash));
+  return fileName + '.' + key + PARTIAL_DOWNLOAD_SUFFIX;
+}
+
+// Removes partial files of fileName left by downloads from other URLs, they can not be continued
+static void removeOtherPartials(const string& fileName, const string& partName)
+{
+  string pattern;
+  for (auto c : fileName)
+  {
+    if (strchr("*?[\\", c))
+      pattern += '\\';
+    pattern += c;
+  }
+  pattern += ".????????????????" + PARTIAL_DOWNLOAD_SUFFIX;
+
+  glob_t matches;
+  if (glob(pattern.c_str(), 0, nullptr, &matches) == 0)
+    for (size_t i = 0; i < matches.gl_pathc; ++i)
+      if (partName != matches.gl_pathv[i])
+        remove(matches.gl_pathv[i]);
+  globfree(&matches);
+  // Partial files of earlier versions are not named by the URL
+  remove((fileName + PARTIAL_DOWNLOAD_SUFFIX).c_str());
+}
+
+static void syncDirectoryOf(const string& fileName)
+{
+  string path = fileName;
+  auto fd = open(dirname(&path[0]), O_RDONLY | O_DIRECTORY);
+  if (fd >= 0)
+  {
+    fsync(fd);
+    close(fd);
+  }
+}
+
+void Downloader::startWriting(transfer* download)
+{
+  download->started = true;
+
+  curl_off_t length = -1;
+  curl_easy_getinfo(download->handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+  if (length > 0)
+    fallocate(fileno(download->file), FALLOC_FL_KEEP_SIZE, download->offset, length);
+}
+
+size_t Downloader::readHeader(char *buffer, size_t size, size_t nitems, void *userdata)
+{
+  // Range not satisfiable response tells the size of the complete file as "Content-Range: bytes */size"
+  static const char prefix[] = "Content-Range: bytes */";
+  auto length = size * nitems;
+  auto prefixLength = sizeof(prefix) - 1;
+  if (length > prefixLength && strncasecmp(buffer, prefix, prefixLength) == 0)
+    static_cast<transfer*>(userdata)->completeSize = strtoll(string(buffer + prefixLength, length - prefixLength).c_str(),
+                                                             nullptr, 10);
+  return length;
+}
+
+size_t Downloader::writeData(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+  auto download = static_cast<transfer*>(userdata);
+  if (!download->started)
+    startWriting(download);
+  // A short write aborts the transfer when the budget runs out, the .part file is kept for resuming
+  auto length = takeBudget(size * nmemb);
+  if (length < size * nmemb)
+    budgetExhausted();
+  throttle(length);
+  return length ? fwrite(ptr, 1, length, download->file) : 0;
+}
+
+Downloader::Downloader(unsigned maxTransfers)
+  : maxTransfers(maxTransfers ? maxTransfers : 1)
+{
+  share = curl_share_init();
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+  multi = curl_multi_init();
+  curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+  curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, static_cast<long>(this->maxTransfers));
+
+  worker = thread(&Downloader::run, this);
+}
+
+Downloader::~Downloader()
+{
+  finish();
+  for (auto handle : idleHandles)
+    curl_easy_cleanup(handle);
+  curl_multi_cleanup(multi);
+  curl_share_cleanup(share);
+}
+
+void Downloader::download(const string& url, const string& fileName, completionHandler done)
+{
+  {
+    lock_guard<std::mutex> lock(mutex);
+    pending.emplace_back(new transfer{url, fileName, move(done), nullptr, nullptr, 0, false, -1});
+  }
+  queued.notify_one();
+  curl_multi_wakeup(multi);
+}
+
+void Downloader::finish()
+{
+  {
+    lock_guard<std::mutex> lock(mutex);
+    if (finishing)
+      return;
+    finishing = true;
+  }
+  queued.notify_one();
+  curl_multi_wakeup(multi);
+  worker.join();
+}
+
+void Downloader::run()
+{
+  while (true)
+  {
+    vector<unique_ptr<transfer>> starting;
+    {
+      unique_lock<std::mutex> lock(mutex);
+      if (active.empty())
+        queued.wait(lock, [this] { return finishing || !pending.empty(); });
+      if (finishing && pending.empty() && active.empty())
+        break;
+      // A download to a file already being written waits in the queue until the earlier one is done
+      for (auto next = pending.begin(); next != pending.end() && active.size() + starting.size() < maxTransfers;)
+        if (activeFiles.insert((*next)->fileName).second)
+        {
+          starting.push_back(move(*next));
+          next = pending.erase(next);
+        }
+        else
+          ++next;
+    }
+    for (auto& download : starting)
+      start(move(download));
+
+    int running = 0;
+    curl_multi_perform(multi, &running);
+
+    int messagesLeft = 0;
+    while (auto message = curl_multi_info_read(multi, &messagesLeft))
+      if (message->msg == CURLMSG_DONE)
+        complete(message->easy_handle, message->data.result);
+
+    if (!active.empty())
+      curl_multi_poll(multi, nullptr, 0, 1000, nullptr);
+  }
+}
+
+void Downloader::start(unique_ptr<transfer> download)
+{
+  if (budgetExhausted())
+  {
+    finished(move(download), false);
+    return;
+  }
+
+  // Append mode, so a partial download left by an earlier run is continued
+  auto partName = partialFileName(download->fileName, download->url);
+  if (!download->offset)
+    removeOtherPartials(download->fileName, partName);
+  download->file = fopen(partName.c_str(), "ab");
+  if (!download->file)
+  {
+    finished(move(download), false);
+    return;
+  }
+  fseeko(download->file, 0, SEEK_END);
+  download->offset = ftello(download->file);
+
+  // Easy handles are reused, so finished transfers keep their connections for the next ones
+  CURL* handle;
+  if (!idleHandles.empty())
+  {
+    handle = idleHandles.back();
+    idleHandles.pop_back();
+    curl_easy_reset(handle);
+  }
+  else
+    handle = curl_easy_init();
+
+  curl_easy_setopt(handle, CURLOPT_URL, download->url.c_str());
+  curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, writeData);
+  curl_easy_setopt(handle, CURLOPT_WRITEDATA, download.get());
+  curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, readHeader);
+  curl_easy_setopt(handle, CURLOPT_HEADERDATA, download.get());
+  if (download->offset > 0)
+    curl_easy_setopt(handle, CURLOPT_RESUME_FROM_LARGE, download->offset);
+  curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(handle, CURLOPT_FAILONERROR, 1L);
+  curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+  curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+  curl_easy_setopt(handle, CURLOPT_SHARE, share);
+
+  download->handle = handle;
+  curl_multi_add_handle(multi, handle);
+  active[handle] = move(download);
+}
+
+void Downloader::complete(CURL* handle, CURLcode result)
+{
+  curl_multi_remove_handle(multi, handle);
+  idleHandles.push_back(handle);
+
+  auto download = move(active[handle]);
+  active.erase(handle);
+
+  curl_off_t totalTime = 0;
+  curl_off_t downloadedBytes = 0;
+  curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME_T, &totalTime);
+  curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &downloadedBytes);
+  syncStats.recordCall("download", totalTime / 1e6, result, downloadedBytes);
+
+  auto partName = partialFileName(download->fileName, download->url);
+  long responseCode = 0;
+  curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &responseCode);
+  // Range not satisfiable - the partial file is complete only when it has the size of the file
+  auto rangeNotSatisfiable = result == CURLE_HTTP_RETURNED_ERROR && responseCode == 416 && download->offset > 0;
+  auto partialComplete = rangeNotSatisfiable && download->completeSize == download->offset;
+  if ((result == CURLE_RANGE_ERROR || rangeNotSatisfiable) && download->offset > 0 && !partialComplete)
+  {
+    // Server does not support range requests or the partial file does not fit the file,
+    // start the download from the beginning
+    fclose(download->file);
+    if (truncate(partName.c_str(), 0) == 0)
+    {
+      download->started = false;
+      download->completeSize = -1;
+      start(move(download));
+      return;
+    }
+    finished(move(download), false);
+    return;
+  }
+
+  auto success = result == CURLE_OK || partialComplete;
+
+  if (success)
+    success = fflush(download->file) == 0 && fsync(fileno(download->file)) == 0;
+  auto empty = ftello(download->file) == 0;
+  success = fclose(download->file) == 0 && success;
+
+  if (!success && empty)
+    remove(partName.c_str());
+  if (success)
+  {
+    success = rename(partName.c_str(), download->fileName.c_str()) == 0;
+    if (success)
+      syncDirectoryOf(download->fileName);
+  }
+  finished(move(download), success);
+}
+
+void Downloader::finished(unique_ptr<transfer> download, bool success)
+{
+  activeFiles.erase(download->fileName);
+  download->done(success);
+}
@@ -0,0 +1,90 @@
+/*
+ *
+ * flickrsync utility - Parallel download engine
+ *
+ */
+
+#ifndef DOWNLOADER_H
+#define DOWNLOADER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <curl/curl.h>
+
+extern const std::string PARTIAL_DOWNLOAD_SUFFIX;
+
+// Limits all downloads of the run, 0 for no limit: maxBytesPerSecond is shared by all concurrent
+// transfers, after maxBytes no more data is received and the remaining .part files are resumed
+// on a later run
+void setDownloadLimits(int64_t maxBytesPerSecond, int64_t maxBytes);
+
+// Downloads files with curl multi interface on a background thread. All transfers
+// share one connection cache (and DNS/TLS session caches), HTTP/2 transfers to the
+// same host are multiplexed over one connection.
+// Files are written to {fileName}.{URL hash}.part first and renamed into place once complete,
+// an existing .part file is resumed with a HTTP range request. The .part file is named by the URL,
+// so a download of another size or version of the photo/video does not continue it. Downloads to the same file
+// (e.g. photos with the same title) are run one after another, the last one wins.
+class Downloader
+{
+public:
+  typedef std::function<void(bool success)> completionHandler;
+
+  explicit Downloader(unsigned maxTransfers);
+  ~Downloader();
+
+  // Queues download of url to fileName, done is called from the download thread when finished
+  void download(const std::string& url, const std::string& fileName, completionHandler done);
+  // Waits until all queued downloads are finished
+  void finish();
+
+private:
+  struct transfer {
+    std::string url;
+    std::string fileName;
+    completionHandler done;
+    FILE* file;
+    CURL* handle;
+    curl_off_t offset;
+    bool started;
+    // Size of the complete file reported by a range not satisfiable response, -1 when not known
+    curl_off_t completeSize;
+  };
+
+  static size_t writeData(void *ptr, size_t size, size_t nmemb, void *userdata);
+  static size_t readHeader(char *buffer, size_t size, size_t nitems, void *userdata);
+  static void startWriting(transfer* download);
+
+  void run();
+  void start(std::unique_ptr<transfer> download);
+  void complete(CURL* handle, CURLcode result);
+  void finished(std::unique_ptr<transfer> download, bool success);
+
+  const unsigned maxTransfers;
+  CURLM* multi;
+  CURLSH* share;
+  std::vector<CURL*> idleHandles;
+  std::map<CURL*,std::unique_ptr<transfer>> active;
+  // Target files of the active transfers
+  std::set<std::string> activeFiles;
+
+  std::mutex mutex;
+  std::condition_variable queued;
+  std::deque<std::unique_ptr<transfer>> pending;
+  bool finishing{false};
+  std::thread worker;
+};
+
+#endif // DOWNLOADER_H
@@ -0,0 +1,75 @@
+/*
+ *
+ * flickrsync utility - Duplicate photo detection
+ *
+ */
+
+#include <stdint.h>
+
+#include "duplicates.h"
+#include "indextable.h"
+
+using namespace std;
+
+namespace {
+
+// Group of photos with the same metadata and its photo with the lowest id
+struct duplicateGroup {
+  PhotoSet::metadataKey metadata;
+  PhotoSet::const_iterator survivor;
+};
+
+uint64_t metadataHash(const PhotoSet::metadataKey& key)
+{
+  auto result = (key.dateTaken ^ key.title) * 0x9e3779b97f4a7c15ULL;
+  result = (result ^ key.description) * 0x9e3779b97f4a7c15ULL;
+  return result ^ (result >> 32);
+}
+
+}
+
+bool photoIdLess(const string& a, const string& b)
+{
+  if (a.length() != b.length())
+    return a.length() < b.length();
+  return a < b;
+}
+
+vector<duplicatePhoto> findDuplicates(const PhotoSet& photos)
+{
+  // Interned metadata is equal exactly when title, date taken and description are, so photos are grouped by it
+  // and ids are compared only within a group
+  vector<duplicateGroup> groups;
+  IndexTable groupsByMetadata;
+  auto hashOf = [&groups](uint32_t group) { return metadataHash(groups[group].metadata); };
+  groupsByMetadata.reserve(photos.size(), hashOf);
+  vector<uint32_t> groupOfPhoto;
+  groupOfPhoto.reserve(photos.size());
+  for (auto photo = photos.begin(); photo != photos.end(); ++photo)
+  {
+    auto metadata = photos.metadata(photo);
+    auto hash = metadataHash(metadata);
+    auto group = groupsByMetadata.find(hash, [&](uint32_t group) { return groups[group].metadata == metadata; });
+    if (group == IndexTable::NOT_FOUND)
+    {
+      group = static_cast<uint32_t>(groups.size());
+      groups.push_back({metadata, photo});
+      groupsByMetadata.insert(hash, group, hashOf);
+    }
+    else if (photoIdLess(photos.photoId(photo), photos.photoId(groups[group].survivor)))
+      groups[group].survivor = photo;
+    groupOfPhoto.push_back(group);
+  }
+
+  vector<duplicatePhoto> duplicates;
+  if (groups.size() == photos.size())
+    return duplicates;
+  auto group = groupOfPhoto.begin();
+  for (auto photo = photos.begin(); photo != photos.end(); ++photo, ++group)
+  {
+    auto survivor = groups[*group].survivor;
+    if (survivor != photo)
+      duplicates.push_back({photos.photoId(photo), photos.photoId(survivor)});
+  }
+  return duplicates;
+}
@@ -0,0 +1,28 @@
+/*
+ *
+ * flickrsync utility - Duplicate photo detection
+ *
+ */
+
+#ifndef DUPLICATES_H
+#define DUPLICATES_H
+
+#include <string>
+#include <vector>
+
+#include "photoset.h"
+
+struct duplicatePhoto {
+  std::string photoId;
+  std::string survivorId;
+};
+
+// Finds photos with the same title, date taken and description in one pass over the set.
+// Of each group of duplicates the photo with the lowest (oldest) id survives, all others
+// are returned in set order.
+std::vector<duplicatePhoto> findDuplicates(const PhotoSet& photos);
+
+// Photo ids are numeric strings, compares them by value
+bool photoIdLess(const std::string& a, const std::string& b);
+
+#endif // DUPLICATES_H
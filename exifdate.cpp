@@ -0,0 +1,234 @@
+/*
+ *
+ * flickrsync utility - Date taken from local photo/video metadata
+ *
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <thread>
+
+#include "exifdate.h"
+#include "workqueue.h"
+
+using namespace std;
+
+const size_t EXIF_READ_SIZE{128 * 1024};        // JPEG APP1 segment is at most 64 KiB
+const int MAX_TOP_LEVEL_BOXES{64};
+const int64_t QUICKTIME_EPOCH_OFFSET{2082844800}; // seconds from 1904-01-01 to 1970-01-01
+
+const uint16_t TAG_DATE_TIME{0x0132};
+const uint16_t TAG_EXIF_IFD{0x8769};
+const uint16_t TAG_DATE_TIME_ORIGINAL{0x9003};
+
+static uint16_t get16(const uint8_t* p, bool littleEndian)
+{
+  return littleEndian ? p[0] | p[1] << 8 : p[0] << 8 | p[1];
+}
+
+static uint32_t get32(const uint8_t* p, bool littleEndian)
+{
+  return littleEndian ? p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24
+                      : static_cast<uint32_t>(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static uint64_t get64(const uint8_t* p)
+{
+  return static_cast<uint64_t>(get32(p, false)) << 32 | get32(p + 4, false);
+}
+
+// Finds value (or value offset) of IFD entry with tag
+static bool findTag(const uint8_t* tiff, size_t length, uint32_t ifd, bool littleEndian, uint16_t tag,
+                    uint32_t* count, uint32_t* value)
+{
+  if (length < 2 || ifd > length - 2)
+    return false;
+  auto entries = get16(tiff + ifd, littleEndian);
+  for (size_t entry = ifd + 2, i = 0; i < entries && entry + 12 <= length; ++i, entry += 12)
+    if (get16(tiff + entry, littleEndian) == tag)
+    {
+      *count = get32(tiff + entry + 4, littleEndian);
+      *value = get32(tiff + entry + 8, littleEndian);
+      return true;
+    }
+  return false;
+}
+
+// Converts EXIF date (YYYY:MM:DD HH:MM:SS) to date taken format
+static string exifDate(const uint8_t* tiff, size_t length, uint32_t count, uint32_t offset)
+{
+  const char* format = "dddd:dd:dd dd:dd:dd";
+  const size_t dateLength = strlen(format);
+  if (count < dateLength || offset > length || length - offset < dateLength)
+    return "";
+
+  string date(reinterpret_cast<const char*>(tiff + offset), dateLength);
+  for (size_t i = 0; i < dateLength; ++i)
+    if (format[i] == 'd' ? date[i] < '0' || date[i] > '9' : date[i] != format[i])
+      return "";
+  if (date.compare(0, 4, "0000") == 0)
+    return "";
+  date[4] = '-';
+  date[7] = '-';
+  return date;
+}
+
+static string tiffDate(const uint8_t* tiff, size_t length)
+{
+  if (length < 8)
+    return "";
+  bool littleEndian;
+  if (tiff[0] == 'I' && tiff[1] == 'I')
+    littleEndian = true;
+  else if (tiff[0] == 'M' && tiff[1] == 'M')
+    littleEndian = false;
+  else
+    return "";
+  if (get16(tiff + 2, littleEndian) != 42)
+    return "";
+
+  auto ifd0 = get32(tiff + 4, littleEndian);
+  uint32_t count, value;
+  if (findTag(tiff, length, ifd0, littleEndian, TAG_EXIF_IFD, &count, &value) &&
+      findTag(tiff, length, value, littleEndian, TAG_DATE_TIME_ORIGINAL, &count, &value))
+  {
+    auto date = exifDate(tiff, length, count, value);
+    if (!date.empty())
+      return date;
+  }
+  if (findTag(tiff, length, ifd0, littleEndian, TAG_DATE_TIME, &count, &value))
+    return exifDate(tiff, length, count, value);
+  return "";
+}
+
+static string jpegDate(const uint8_t* data, size_t length)
+{
+  size_t position = 2;
+  while (position + 4 <= length && data[position] == 0xFF)
+  {
+    auto marker = data[position + 1];
+    if (marker == 0xFF)
+    {
+      ++position;
+      continue;
+    }
+    // Image data starts, no metadata after it
+    if (marker == 0xDA || marker == 0xD9)
+      break;
+    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+    {
+      position += 2;
+      continue;
+    }
+
+    size_t segmentLength = get16(data + position + 2, false);
+    if (marker == 0xE1 && segmentLength >= 8 && position + 10 <= length &&
+        memcmp(data + position + 4, "Exif\0\0", 6) == 0)
+      return tiffDate(data + position + 10, min(segmentLength - 8, length - position - 10));
+    position += 2 + segmentLength;
+  }
+  return "";
+}
+
+// Finds box of type within [offset, end), returns its content offset and end
+static bool findBox(int fd, off_t offset, off_t end, const char* type, off_t* contentOffset, off_t* contentEnd)
+{
+  for (int i = 0; i < MAX_TOP_LEVEL_BOXES && offset + 8 <= end; ++i)
+  {
+    uint8_t header[16];
+    if (pread(fd, header, sizeof(header), offset) < 8)
+      return false;
+    uint64_t size = get32(header, false);
+    off_t headerSize = 8;
+    if (size == 1)
+    {
+      size = get64(header + 8);
+      headerSize = 16;
+    }
+    else if (size == 0)
+      size = end - offset;
+    if (size < static_cast<uint64_t>(headerSize) || size > static_cast<uint64_t>(end - offset))
+      return false;
+
+    if (memcmp(header + 4, type, 4) == 0)
+    {
+      *contentOffset = offset + headerSize;
+      *contentEnd = offset + size;
+      return true;
+    }
+    offset += size;
+  }
+  return false;
+}
+
+// QuickTime creation time is in UTC, unlike EXIF dates in local time of the camera
+static string quickTimeDate(int fd, off_t fileSize)
+{
+  off_t moov, moovEnd, mvhd, mvhdEnd;
+  if (!findBox(fd, 0, fileSize, "moov", &moov, &moovEnd) || !findBox(fd, moov, moovEnd, "mvhd", &mvhd, &mvhdEnd))
+    return "";
+
+  uint8_t header[12];
+  if (mvhdEnd - mvhd < static_cast<off_t>(sizeof(header)) || pread(fd, header, sizeof(header), mvhd) != sizeof(header))
+    return "";
+  int64_t creationTime = header[0] == 1 ? get64(header + 4) : get32(header + 4, false);
+  if (creationTime <= QUICKTIME_EPOCH_OFFSET)
+    return "";
+
+  time_t time = creationTime - QUICKTIME_EPOCH_OFFSET;
+  struct tm fields;
+  char date[32];
+  if (!gmtime_r(&time, &fields) || !strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &fields))
+    return "";
+  return date;
+}
+
+static bool isQuickTime(const uint8_t* data, size_t length)
+{
+  static const char* types[] = {"ftyp", "moov", "wide", "free", "mdat", "skip"};
+  if (length < 8)
+    return false;
+  for (auto type : types)
+    if (memcmp(data + 4, type, 4) == 0)
+      return true;
+  return false;
+}
+
+string readDateTaken(const string& filePath)
+{
+  auto fd = open(filePath.c_str(), O_RDONLY);
+  if (fd < 0)
+    return "";
+
+  string date;
+  struct stat status;
+  vector<uint8_t> data(EXIF_READ_SIZE);
+  auto length = fstat(fd, &status) ? -1 : pread(fd, data.data(), data.size(), 0);
+  if (length >= 4)
+  {
+    if (data[0] == 0xFF && data[1] == 0xD8)
+      date = jpegDate(data.data(), length);
+    else if (data[0] == data[1] && (data[0] == 'I' || data[0] == 'M'))
+      date = tiffDate(data.data(), length);
+    else if (isQuickTime(data.data(), length))
+      date = quickTimeDate(fd, status.st_size);
+  }
+  close(fd);
+  return date;
+}
+
+vector<string> readDatesTaken(const vector<string>& filePaths)
+{
+  vector<string> dates(filePaths.size());
+  runConcurrently(filePaths.size(), max(1u, thread::hardware_concurrency()), [&](unsigned, size_t i)
+  {
+    dates[i] = readDateTaken(filePaths[i]);
+  });
+  return dates;
+}
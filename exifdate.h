@@ -0,0 +1,21 @@
+/*
+ *
+ * flickrsync utility - Date taken from local photo/video metadata
+ *
+ */
+
+#ifndef EXIFDATE_H
+#define EXIFDATE_H
+
+#include <string>
+#include <vector>
+
+// Reads date taken from EXIF of JPEG and TIFF based (raw) photos, or creation time from movie header of
+// QuickTime/MP4 videos. Only the metadata is read, not the whole file. Returns the date in Flickr date
+// taken format (YYYY-MM-DD HH:MM:SS), empty when the file has no date.
+std::string readDateTaken(const std::string& filePath);
+
+// Reads dates taken of files in parallel
+std::vector<std::string> readDatesTaken(const std::vector<std::string>& filePaths);
+
+#endif // EXIFDATE_H
@@ -8,39 +8,58 @@
 #include <string.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 #include <errno.h>
 #include <getopt.h>
+#include <glob.h>
 
 #include <QDir>
-#include <QRegularExpression>
 
-#include <random>
+#include <atomic>
+#include <functional>
 #include <string>
 #include <set>
+#include <unordered_set>
+#include <mutex>
+#include <thread>
 
 #include <libxml/tree.h>
 #include <flickcurl.h>
 #include <curl/curl.h>
 
+#include "contenthash.h"
+#include "downloader.h"
+#include "duplicates.h"
+#include "exifdate.h"
+#include "flickrsync.h"
+#include "manifest.h"
+#include "photoindex.h"
+#include "photoset.h"
+#include "randomphoto.h"
+#include "ratelimiter.h"
+#include "renamer.h"
+#include "scanner.h"
+#include "setlisting.h"
+#include "syncplan.h"
+#include "titleorder.h"
+#include "titlepolicy.h"
+#include "uploadpool.h"
+#include "watcher.h"
+#include "workqueue.h"
+
 using namespace std;
 
-const int CORRECT_DATE_BASED_NAME_LENGTH{15}; // Length of YYYYMMDD-HHMMSS
 int verbose{1};
 const char* program{"flickrsync"};
 
-struct photoInfo {
-  string title;
-  string dateTaken;
-  string description;
-};
-
 static void FlickrSyncMessageHandler(void *, const char *message)
 {
   fprintf(stderr, "%s: ERROR: %s\n", program, message);
+  recordApiError(message);
 }
 
-#define GETOPT_STRING "hnrfdsog:"
+#define GETOPT_STRING "hnrfdsoT:FciRwg:Pj:S:B:p:a:z:L:b:"
 
 static struct option long_options[] =
 {
@@ -52,7 +71,22 @@ static struct option long_options[] =
   {"download-missing",  0, 0, 'd'},
   {"sort-by-title",  0, 0, 's'},
   {"set-titles-by-date-taken",  0, 0, 'o'},
+  {"full-sync",  0, 0, 'F'},
+  {"content-hash",  0, 0, 'c'},
+  {"account-index",  0, 0, 'i'},
+  {"recursive",  0, 0, 'R'},
+  {"watch",  0, 0, 'w'},
   {"get-random-photo",  1, 0, 'g'},
+  {"prefetch",  0, 0, 'P'},
+  {"jobs",  1, 0, 'j'},
+  {"stats",  1, 0, 'S'},
+  {"api-budget",  1, 0, 'B'},
+  {"title-template",  1, 0, 'T'},
+  {"plan-out",  1, 0, 'p'},
+  {"apply",  1, 0, 'a'},
+  {"size",  1, 0, 'z'},
+  {"limit-rate",  1, 0, 'L'},
+  {"download-budget",  1, 0, 'b'},
   {NULL,      0, 0, 0}
 };
 
@@ -71,12 +105,37 @@ static void printHelpString(void)
          "                                 to the end of Flickr oauth authentication URL during authentication setup)\n"
          "  -s, --sort-by-title            Sort photos/videos by title after syncing\n"
          "  -o, --set-titles-by-date-taken Set photo titles by title daken (in form YYYYMMDD-HHMMSS)\n"
+         "  -T, --title-template {t}       Template of titles set by -o (default %%Y%%m%%d-%%H%%M%%S)\n"
+         "  -F, --full-sync                List folder and photoset fully, ignoring the sync manifest\n"
+         "  -c, --content-hash             Match photos/videos by content hash instead of file name\n"
+         "  -i, --account-index            With -c, add photos/videos already elsewhere in the Flickr account to the set\n"
+         "                                 instead of uploading them again\n"
+         "  -R, --recursive                Sync each subfolder of folder to photoset of the same name\n"
+         "                                 (with -j, n subfolders are synced concurrently)\n"
+         "  -w, --watch                    After syncing, keep watching folder(s) and upload new photos/videos as they appear\n"
          "  -g, --get-random-photo {file}  Download random photo from album to {file} (if no folder is specified random album is chosen)\n"
+         "  -P, --prefetch                 With -g, download the next random photo ahead to {file}.next.*\n"
+         "  -j, --jobs {n}                 Upload/download n photos/videos concurrently (default 1)\n"
+         "  -z, --size {labels}            Download the first of comma separated Flickr sizes available (e.g. \"Large 2048,Large\"),\n"
+         "                                 falling back to the original (default Original)\n"
+         "  -L, --limit-rate {KB/s}        Download at most KB/s in total\n"
+         "  -b, --download-budget {MB}     Download at most MB in this run, the rest is resumed on the next run\n"
+         "  -S, --stats {file.json}        Write API call latencies, errors and sync phase times to file\n"
+         "  -B, --api-budget {n}           Make at most n Flickr API calls per hour (default 3600)\n"
+         "  -p, --plan-out {plan}          Dry run, writing the changes to make to {plan} file\n"
+         "  -a, --apply {plan}             Make the changes of {plan} file written by --plan-out (no folder is needed)\n"
          "  -h, --help                     Print this help, then exit\n\n"
          , program);
 }
 
 const string FLICKCURL_CONFIGFILE_NAME{".flickcurl.conf"};
+const string FLICKR_PHOTO_SOURCE_URL{"https://live.staticflickr.com/"};
+// Environment variables pointing API, upload and photo source at another server (e.g. local stand-in for Flickr)
+const char* API_URI_VARIABLE{"FLICKRSYNC_API_URI"};
+const char* UPLOAD_URI_VARIABLE{"FLICKRSYNC_UPLOAD_URI"};
+const char* PHOTO_SOURCE_URL_VARIABLE{"FLICKRSYNC_PHOTO_SOURCE_URL"};
+// Listing extras needed to download originals without a getSizes call per photo
+const char* PHOTO_LIST_EXTRAS{"date_upload,date_taken,description,url_o,original_format,media,machine_tags"};
 
 bool dryRun = false;
 flickcurl *fc = nullptr;
@@ -89,11 +148,59 @@ string flickcurlConfigFile()
   return FLICKCURL_CONFIGFILE_NAME;
 }
 
+static void setServiceUris(flickcurl* session)
+{
+  if (auto uri = getenv(API_URI_VARIABLE))
+    flickcurl_set_service_uri(session, uri);
+  if (auto uri = getenv(UPLOAD_URI_VARIABLE))
+    flickcurl_set_upload_service_uri(session, uri);
+}
+
+static const string& photoSourceUrl()
+{
+  static const string url = getenv(PHOTO_SOURCE_URL_VARIABLE) ? getenv(PHOTO_SOURCE_URL_VARIABLE) : FLICKR_PHOTO_SOURCE_URL;
+  return url;
+}
+
+flickcurl* newFlickcurlSession()
+{
+  // Reading the config file is not thread safe
+  static mutex sessionMutex;
+  lock_guard<mutex> lock(sessionMutex);
+  auto session = flickcurl_new();
+  if (!session)
+    return nullptr;
+
+  flickcurl_set_error_handler(session, FlickrSyncMessageHandler, NULL);
+  if (flickcurl_config_read_ini(session, flickcurlConfigFile().c_str(), "flickr", session, flickcurl_config_var_handler))
+  {
+    flickcurl_free(session);
+    return nullptr;
+  }
+  setServiceUris(session);
+  return session;
+}
+
+void forEachConcurrently(flickcurl* fc, size_t count, unsigned jobs,
+                         const function<void(flickcurl* session, size_t index)>& work)
+{
+  // Sessions are created upfront on the calling thread, not by each worker
+  vector<flickcurl*> sessions{fc};
+  for (unsigned i = 1; i < jobs && i < count; ++i)
+    if (auto session = newFlickcurlSession())
+      sessions.emplace_back(session);
+
+  runConcurrently(count, sessions.size(), [&](unsigned worker, size_t i) { work(sessions[worker], i); });
+  for (size_t i = 1; i < sessions.size(); ++i)
+    flickcurl_free(sessions[i]);
+}
+
 string createPhotoSet(flickcurl* fc, const string& name, const string& primaryPhotoId)
 {
   string setId;
   char* url = nullptr;
-  if (auto id = flickcurl_photosets_create(fc, name.c_str(), nullptr, primaryPhotoId.c_str(), &url))
+  if (auto id = limitedApiCall("flickr.photosets.create", [&] {
+        return flickcurl_photosets_create(fc, name.c_str(), nullptr, primaryPhotoId.c_str(), &url); }, false))
   {
     printf("New photoset '%s' created (id=%s, URL=%s)\n", name.c_str(), id, url);
     setId = id;
@@ -106,9 +213,18 @@ string createPhotoSet(flickcurl* fc, const string& name, const string& primaryPh
 bool addToSet(flickcurl* fc, const string& photoId, const string& setName, string* setId)
 {
   if (setId->empty())
+  {
+    // The photo becomes the primary photo of the new set, so it is in the set only when creating succeeded
     *setId = createPhotoSet(fc, setName, photoId);
+    if (setId->empty())
+    {
+      printf("ERROR: Unable to create set '%s' for uploaded photo/video 'id=%s'\n", setName.c_str(), photoId.c_str());
+      return false;
+    }
+  }
   else
-    if (auto ret = flickcurl_photosets_addPhoto(fc, setId->c_str(), photoId.c_str()))
+    if (auto ret = limitedApiCall("flickr.photosets.addPhoto", [&] {
+          return flickcurl_photosets_addPhoto(fc, setId->c_str(), photoId.c_str()); }))
     {
       printf("ERROR: Unable to add uploaded photo/video 'id=%s' to set '%s': %d\n",
              photoId.c_str(), setName.c_str(), ret);
@@ -117,108 +233,932 @@ bool addToSet(flickcurl* fc, const string& photoId, const string& setName, strin
   return true;
 }
 
-static size_t curlWriteDataHandler(void *ptr, size_t size, size_t nmemb, void *stream)
+static string photoField(const flickcurl_photo* photo, flickcurl_photo_field_type field)
+{
+  auto value = photo->fields[field].string;
+  return value ? value : "";
+}
+
+photoInfo photoInfoFromListing(const flickcurl_photo* photo)
+{
+  photoInfo info;
+  info.title = photoField(photo, PHOTO_FIELD_title);
+  info.dateTaken = photoField(photo, PHOTO_FIELD_dates_taken);
+  info.description = photoField(photo, PHOTO_FIELD_description);
+  if (photo->media_type)
+    info.media = photo->media_type;
+  info.originalFormat = photoField(photo, PHOTO_FIELD_originalformat);
+  for (int i = 0; i < photo->tags_count && info.contentHash.empty(); ++i)
+    info.contentHash = contentHashFromTag(photo->tags[i]->raw);
+  // Server and original secret are returned with original_format extras
+  info.server = photoField(photo, PHOTO_FIELD_server);
+  info.originalSecret = photoField(photo, PHOTO_FIELD_originalsecret);
+  return info;
+}
+
+string originalPhotoUrl(const string& photoId, const photoInfo& info)
+{
+  if (info.server.empty() || info.originalSecret.empty() || info.originalFormat.empty())
+    return "";
+  return photoSourceUrl() + info.server + '/' + photoId + '_' + info.originalSecret + "_o." + info.originalFormat;
+}
+
+string titleFromFileName(const string& fileName)
 {
-  size_t written = fwrite(ptr, size, nmemb, (FILE *)stream);
-  return written;
+  // Same as QFileInfo::baseName().toLower(), avoiding QString conversion for plain ASCII names
+  auto baseName = fileName.substr(0, fileName.find('.'));
+  for (auto& c : baseName)
+    if (static_cast<unsigned char>(c) >= 0x80)
+      return QString::fromStdString(baseName).toLower().toStdString();
+    else if (c >= 'A' && c <= 'Z')
+      c += 'a' - 'A';
+  return baseName;
 }
 
-bool downloadFile(const string& url, const string& fileName)
+string uploadPhoto(flickcurl* fc, const string& title, const string& filePath, const string& contentHash)
 {
-  auto result{false};
-  auto curl_handle = curl_easy_init();
-  curl_easy_setopt(curl_handle, CURLOPT_URL, url.c_str());
-  curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, curlWriteDataHandler);
-  curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, true);
-  if (auto fileHandle = fopen(fileName.c_str(), "wb"))
+  auto tags = contentHash.empty() ? string() : CONTENT_HASH_MACHINE_TAG + contentHash;
+
+  flickcurl_upload_params params;
+  memset(&params, '\0', sizeof(flickcurl_upload_params));
+  params.safety_level = 1;
+  params.content_type = 1;
+  params.hidden = 1;
+  params.is_family = 1;
+  params.title = title.c_str();
+  params.photo_file = filePath.c_str();
+  if (!tags.empty())
+    params.tags = tags.c_str();
+
+  string photoId;
+  // Not retried, failed upload may have still created the photo
+  apiRateLimiter.acquire();
+  recordApiError(nullptr);
+  ApiCallTimer timer("upload");
+  auto status = flickcurl_photos_upload_params(fc, &params);
+  timer.done(apiErrorCode(status), QFileInfo(QString(filePath.c_str())).size());
+  // Upload time depends on the file size, so it tells nothing of congestion
+  apiRateLimiter.release(nullptr, 0, apiCallOutcome(apiErrorCode(status)));
+  if (status)
   {
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, fileHandle);
-    auto res = curl_easy_perform(curl_handle);
-    if (res == CURLE_OK)
-      result = true;
-    fclose(fileHandle);
+    if (status->photoid)
+      photoId = status->photoid;
+    flickcurl_free_upload_status(status);
   }
-  curl_easy_cleanup(curl_handle);
-  return result;
+  return photoId;
 }
 
+// Size labels to download in order of preference (e.g. "Large 2048"), originals when empty
+static vector<string> downloadSizes;
 
-bool downloadPhoto(const string& photoId, const string& filename, const QDir& folder)
+static bool downloadsOriginals()
 {
-  if (auto sizes = flickcurl_photos_getSizes(fc, photoId.c_str()))
-  {
-    string filePath;
-    string downloadUrl;
+  return downloadSizes.empty() || downloadSizes.front() == "Original";
+}
+
+// Extension of the file in url path, empty when there is none
+static string urlExtension(const string& url)
+{
+  auto path = url.substr(0, url.find_first_of("?#"));
+  auto dot = path.rfind('.');
+  if (dot == string::npos || path.find('/', dot) != string::npos)
+    return "";
+  return path.substr(dot + 1);
+}
+
+// Picks the first size of the preferred labels Flickr has for photo/video, the original when none
+static const flickcurl_size* chooseSize(flickcurl_size** sizes, bool video)
+{
+  const char* media = video ? "video" : "photo";
+  for (const auto& label : downloadSizes)
     for (int i = 0; sizes[i]; ++i)
+      if (strcmp(sizes[i]->media, media) == 0 && label == sizes[i]->label)
+        return sizes[i];
+  for (int i = 0; sizes[i]; ++i)
+    if (strcmp(sizes[i]->media, media) == 0 && strcmp(sizes[i]->label, video ? "Video Original" : "Original") == 0)
+      return sizes[i];
+  return nullptr;
+}
+
+void downloadPhoto(flickcurl* fc, Downloader& downloader, const string& photoId, const photoInfo& info, const string& filename,
+                   const QDir& folder, const function<void()>& downloaded)
+{
+  string filePath;
+  string downloadUrl;
+  // Photo originals are known from the listing, videos and other sizes need getSizes
+  auto originalUrl = originalPhotoUrl(photoId, info);
+  if (info.media == "photo" && !originalUrl.empty() && downloadsOriginals())
+  {
+    filePath = folder.filePath(QString(filename.c_str()) + "." + QString(info.originalFormat.c_str())).toStdString();
+    downloadUrl = originalUrl;
+  }
+  else if (auto sizes = limitedApiCall("flickr.photos.getSizes", [&] { return flickcurl_photos_getSizes(fc, photoId.c_str()); }))
+  {
+    auto video = info.media == "video";
+    for (int i = 0; sizes[i] && info.media.empty(); ++i)
+      video = video || strcmp(sizes[i]->media, "video") == 0;
+    if (auto size = chooseSize(sizes, video))
+    {
+      // Resized photos are JPEGs whatever the original format, the extension is taken from the source URL
+      string extension = "mp4";
+      if (!video && strcmp(size->label, "Original") == 0)
+        extension = info.originalFormat.empty() ? string("jpg") : info.originalFormat;
+      else if (!video)
+        extension = urlExtension(size->source).empty() ? string("jpg") : urlExtension(size->source);
+      filePath = folder.filePath(QString(filename.c_str()) + "." + QString(extension.c_str())).toStdString();
+      downloadUrl = size->source;
+    }
+    flickcurl_free_sizes(sizes);
+  }
+  if (!downloadUrl.empty())
+  {
+    if (!dryRun)
+    {
+      printf("Starting to download photo/video file '%s'\n", filePath.c_str());
+      downloader.download(downloadUrl, filePath, [filePath, downloaded](bool success)
+      {
+        if (success)
+        {
+          printf("Downloading photo/video file '%s' ...Done\n", filePath.c_str());
+          downloaded();
+        }
+        else
+          printf("Downloading photo/video file '%s' ...Failed!\n", filePath.c_str());
+      });
+    }
+    else
+    {
+      printf("Need to download photo/video file '%s'\n", filePath.c_str());
+      downloaded();
+    }
+  }
+}
+
+bool photoExistingInFolder(const map<string,string>& photosInFolder, const unordered_set<string>& contentHashesInFolder,
+                           const photoInfo& photo)
+{
+  if (!photo.contentHash.empty() && !contentHashesInFolder.empty())
+    return contentHashesInFolder.count(photo.contentHash) != 0;
+  return photosInFolder.count(photo.title) != 0;
+}
+
+// Plans titles based on date taken for photos not named by date yet. Planned titles are taken in photos
+// right away, so suffixes for photos taken at the same second are resolved by the title index.
+static vector<titleChange> planDateTakenTitles(PhotoSet* photos)
+{
+  vector<titleChange> changes;
+  string correctName;
+  for (const auto& photo : *photos)
+    if (!titlePolicy.matches(photo.second.title) && titlePolicy.titleFor(photo.second.dateTaken, &correctName) &&
+        photo.second.title.compare(0, correctName.size(), correctName) != 0)
+      changes.push_back({photo.first, photo.second.title, correctName, photo.second.description});
+
+  for (auto& change : changes)
+  {
+    change.newTitle = photos->uniqueTitle(change.newTitle);
+    photos->setTitle(change.photoId, change.newTitle);
+  }
+  return changes;
+}
+
+// Titles uploads by date taken read from local photo/video metadata, so that -o does not need to rename them
+// after upload. Used only with content matching, uploads are then matched to local files by content, not by title.
+// The titles of all uploads are reserved in photos, so suffixes are resolved by the title index, until released
+// after uploading.
+static void titleUploadsByDateTaken(PhotoSet* photos, vector<plannedUpload>* uploads)
+{
+  vector<plannedUpload*> undatedUploads;
+  vector<string> filePaths;
+  for (auto& upload : *uploads)
+    if (titlePolicy.matches(upload.title))
+      photos->reserveTitle(upload.title);
+    else
+    {
+      undatedUploads.push_back(&upload);
+      filePaths.push_back(upload.filePath);
+    }
+
+  auto datesTaken = readDatesTaken(filePaths);
+  string title;
+  for (size_t i = 0; i < undatedUploads.size(); ++i)
+    if (titlePolicy.titleFor(datesTaken[i], &title))
+    {
+      undatedUploads[i]->title = photos->uniqueTitle(title);
+      photos->reserveTitle(undatedUploads[i]->title);
+    }
+}
+
+const unsigned DEFAULT_LISTING_JOBS{4};
+const unsigned DEFAULT_RENAME_JOBS{4};
+
+struct photosetEntry {
+  string id;
+  int photoCount;
+};
+
+struct syncOptions {
+  bool removeNonExisting{false};
+  bool removeDuplicates{false};
+  bool downloadNonExisting{false};
+  bool sortByTitle{false};
+  bool renameByDateTaken{false};
+  bool fullSync{false};
+  bool matchContent{false};
+  unsigned jobs{1};
+  // Concurrent calls for listing the set and setting titles, these are cheap enough to run more of than jobs
+  unsigned listingJobs{DEFAULT_LISTING_JOBS};
+  unsigned renameJobs{DEFAULT_RENAME_JOBS};
+  // Photos of the whole account when matching uploads across sets
+  const PhotoIndex* accountIndex{nullptr};
+};
+
+struct syncSummary {
+  size_t inFolder;
+  size_t uploaded;
+  int deleted;
+  int downloaded;
+  size_t inSet;
+};
+
+// Photo count as reported in photoset list (videos are not counted), -1 when not known
+int photoCountInSetList(const PhotoSet& photos)
+{
+  int count{0};
+  for (const auto& photo : photos)
+    if (photo.second.media.empty())
+      return -1;
+    else if (photo.second.media == "photo")
+      ++count;
+  return count;
+}
+
+// Photos moved per reorder call, the whole set of a large photoset is too large a request
+const size_t REORDER_CHUNK_SIZE{1000};
+
+// Reorders photoset by photo/video titles, photos has the ids and titles of the photos/videos in set order.
+// Photos added to the set in this run are appended in unknown order, so they are always moved.
+// Returns true when the set is in title order afterwards, sortedIds receives the order.
+static bool reorderByTitle(flickcurl* fc, const string& setId, const vector<pair<string,string>>& photos,
+                           const unordered_set<string>& addedIds, vector<string>* sortedIds)
+{
+  *sortedIds = sortedByTitle(photos);
+  auto moved = reorderedPrefixLength(photos, *sortedIds);
+  for (auto i = moved; i < sortedIds->size(); ++i)
+    if (addedIds.count((*sortedIds)[i]))
+      moved = i + 1;
+  if (!moved)
+  {
+    printf("Photoset '%s' is already sorted by photo/video titles\n", setId.c_str());
+    return true;
+  }
+  if (dryRun)
+  {
+    printf("Will reorder photoset '%s' by photo/video titles (%zu photos/videos to move)\n", setId.c_str(), moved);
+    return false;
+  }
+
+  // Reordering moves the listed photos to the front of the set, the others keep their order after them.
+  // Chunks are sent last first, so each chunk ends up in front of the ones sent before it.
+  for (auto end = moved; end > 0;)
+  {
+    auto start = end > REORDER_CHUNK_SIZE ? end - REORDER_CHUNK_SIZE : 0;
+    vector<const char*> reorderedIds;
+    for (auto i = start; i < end; ++i)
+      reorderedIds.emplace_back((*sortedIds)[i].c_str());
+    reorderedIds.emplace_back(nullptr);
+    if (auto ret = limitedApiCall("flickr.photosets.reorderPhotos", [&] {
+          return flickcurl_photosets_reorderPhotos(fc, setId.c_str(), reorderedIds.data()); }))
+    {
+      printf("ERROR: Unable to reorder photoset '%s' by photo/video titles: %d\n", setId.c_str(), ret);
+      return false;
+    }
+    end = start;
+  }
+  printf("Photoset reordered '%s' by photo/video titles (%zu photos/videos moved)\n", setId.c_str(), moved);
+  return true;
+}
+
+// Photosets of the user by title
+map<string,photosetEntry> listPhotosets(flickcurl* fc)
+{
+  map<string,photosetEntry> photosets;
+  if (auto photoset_list = limitedApiCall("flickr.photosets.getList", [&] { return flickcurl_photosets_getList(fc, nullptr); }))
+  {
+    for(int i = 0; photoset_list[i]; i++)
+      photosets[photoset_list[i]->title] = {photoset_list[i]->id, photoset_list[i]->photos_count};
+    flickcurl_free_photosets(photoset_list);
+  }
+  return photosets;
+}
+
+// Adds photos/videos found in the account index by content to the set instead of uploading them again.
+// Returns the photos added to the set by id, uploads keeps the photos that still need uploading.
+static map<string,photoInfo> reuseIndexedPhotos(flickcurl* fc, const PhotoIndex& index, const string& setName,
+                                                string* setId, vector<plannedUpload>* uploads)
+{
+  map<string,photoInfo> reused;
+  vector<plannedUpload> remaining;
+  for (auto& upload : *uploads)
+  {
+    indexedPhoto photo;
+    if (!index.findContent(upload.contentHash, &photo))
+      remaining.push_back(move(upload));
+    else if (dryRun || addToSet(fc, photo.id, setName, setId))
+    {
+      printf("%s existing photo/video %s (id=%s) to set instead of uploading %s\n", dryRun ? "Need to add" : "Added",
+             photo.title.c_str(), photo.id.c_str(), upload.filePath.c_str());
+      auto& info = reused[photo.id];
+      info.title = photo.title;
+      info.contentHash = upload.contentHash;
+    }
+    else
+      remaining.push_back(move(upload));
+  }
+  uploads->swap(remaining);
+  return reused;
+}
+
+// Syncs folder to photoset of the same name, watched receives the synced state for watch mode.
+// In dry run plan receives the changes that would be made.
+syncSummary syncFolder(flickcurl* fc, const QDir& folder, const map<string,photosetEntry>& photosets,
+                       const syncOptions& options, watchedFolder* watched = nullptr, syncPlan* plan = nullptr)
+{
+  string setName = folder.dirName().toStdString();
+  printf("Starting to sync photos/videos from folder '%s' to Flickr...\n", folder.path().toStdString().c_str());
+  PhaseTimer phase("scan");
+  auto manifestPath = folder.filePath(MANIFEST_FILE_NAME).toStdString();
+  SyncManifest manifest;
+  if (!options.fullSync)
+    manifest.load(manifestPath);
+
+  // Title => file name in folder
+  map<string,string> photosInFolder;
+  auto hashCache = manifest.files;
+  auto folderPath = folder.path().toStdString();
+  auto folderMtime = modificationTime(folderPath);
+  if (manifest.hasFolderListing(folderMtime))
+  {
+    printf("Folder not changed since last sync, using file list from sync manifest\n");
+    for (const auto& file : manifest.files)
+      photosInFolder[titleFromFileName(file.fileName)] = file.fileName;
+  }
+  else
+  {
+    manifest.files.clear();
+    auto scanned = scanFolder(folderPath, [&](const char* fileName)
     {
-      if (strcmp(sizes[i]->media, "video") == 0 &&
-          strcmp(sizes[i]->label, "Video Original") == 0)
+      string name(fileName);
+      if (name.size() > PARTIAL_DOWNLOAD_SUFFIX.size() &&
+          name.compare(name.size() - PARTIAL_DOWNLOAD_SUFFIX.size(), string::npos, PARTIAL_DOWNLOAD_SUFFIX) == 0)
+        return;
+
+      auto baseName = titleFromFileName(name);
+      auto inserted = photosInFolder.emplace(baseName, name);
+      if (!inserted.second)
+        printf("ERROR: Photos/videos with duplicate basenames found (%s/%s AND %s/%s) - can not sync correctly\n",
+               folderPath.c_str(), fileName, folderPath.c_str(), inserted.first->second.c_str());
+      else
+        manifest.files.push_back({name, 0, 0, 0, ""});
+    });
+    if (!scanned)
+      printf("ERROR: Unable to list folder '%s'\n", folderPath.c_str());
+  }
+  manifest.folderMtime = folderMtime;
+
+  map<string,string> contentHashesByName;
+  unordered_set<string> contentHashesInFolder;
+  phase.next("hash");
+  if (options.matchContent)
+  {
+    hashFiles(folder.path().toStdString(), &manifest.files, hashCache);
+    for (const auto& file : manifest.files)
+      if (!file.contentHash.empty())
       {
-        filePath = folder.filePath(QString(filename.c_str()) + ".mp4").toStdString();
-        downloadUrl = sizes[i]->source;
-        break;
+        contentHashesByName[titleFromFileName(file.fileName)] = file.contentHash;
+        contentHashesInFolder.insert(file.contentHash);
       }
-      else if (strcmp(sizes[i]->media, "photo") == 0 &&
-               strcmp(sizes[i]->label, "Original") == 0)
+  }
+
+  string setId;
+  int setPhotoCount{-1};
+  auto photoset = photosets.find(setName);
+  if (photoset != photosets.end())
+  {
+    printf("Flickr photoset '%s' (id=%s) is already existing\n", setName.c_str(), photoset->second.id.c_str());
+    setId = photoset->second.id;
+    setPhotoCount = photoset->second.photoCount;
+  }
+
+  phase.next("listing");
+  PhotoSet photosInSet;
+  if (!setId.empty() && manifest.hasSetListing(setId, setPhotoCount, time(nullptr)))
+  {
+    printf("Flickr photoset not changed since last sync, using photo list from sync manifest\n");
+    photosInSet = move(manifest.photos);
+  }
+  else if (!setId.empty())
+  {
+    auto listedAt = time(nullptr);
+    if (!listSetPhotos(fc, setId, setPhotoCount, options.listingJobs, &photosInSet))
+    {
+      // Syncing against incomplete listing would upload photos again
+      printf("ERROR: Unable to list Flickr photoset '%s' - can not sync folder\n", setName.c_str());
+      return syncSummary{photosInFolder.size(), 0, 0, 0, 0};
+    }
+    manifest.setListedAt = listedAt;
+  }
+  phase.next("rename");
+  if (options.renameByDateTaken && photosInSet.size())
+  {
+    auto changes = planDateTakenTitles(&photosInSet);
+    if (!dryRun)
+    {
+      printf("Setting titles of %zu photos/videos based on date taken\n", changes.size());
+      // Failed photos keep their old title
+      for (const auto& change : applyTitleChanges(fc, changes, options.renameJobs))
+        photosInSet.setTitle(change.photoId, change.oldTitle);
+    }
+    else
+    {
+      for (const auto& change : changes)
+        printf("Need to set photo title based on date taken %s => %s\n", change.oldTitle.c_str(),
+               change.newTitle.c_str());
+      if (plan)
+        plan->renames = move(changes);
+    }
+  }
+  phase.next("upload");
+  vector<plannedUpload> plannedUploads;
+  {
+    unordered_set<string> uploadedContent;
+    for (const auto& photoFile : photosInFolder)
+    {
+      auto contentHash = contentHashesByName[photoFile.first];
+      if (!photosInSet.hasPhoto(photoFile.first, contentHash))
       {
-        filePath = folder.filePath(QString(filename.c_str()) + ".jpg").toStdString();
-        downloadUrl = sizes[i]->source;
+        if (!contentHash.empty() && !uploadedContent.insert(contentHash).second)
+          printf("Photo/video %s has the same content as another uploaded photo/video, skipping\n",
+                 photoFile.first.c_str());
+        else
+          plannedUploads.push_back({photoFile.first, folderPath + '/' + photoFile.second, contentHash});
       }
+      else
+        printf("Photo/video %s is already existing in set, skipping\n", photoFile.first.c_str());
+    }
+  }
+  if (options.renameByDateTaken && options.matchContent)
+    titleUploadsByDateTaken(&photosInSet, &plannedUploads);
+  if (dryRun && plan)
+    plan->uploads = plannedUploads;
+
+  map<string,string> uploadedPhotos;
+  unordered_set<string> addedToSet;
+  if (options.accountIndex)
+    for (auto& reused : reuseIndexedPhotos(fc, *options.accountIndex, setName, &setId, &plannedUploads))
+    {
+      uploadedPhotos[reused.second.title] = reused.first;
+      addedToSet.insert(reused.first);
+      photosInSet.add(reused.first, move(reused.second));
     }
-    if (!downloadUrl.empty())
+  {
+    UploadPool uploadPool(dryRun ? 0 : options.jobs, setName, &setId);
+    for (const auto& upload : plannedUploads)
     {
       if (!dryRun)
+        uploadPool.upload(upload.title, upload.filePath, upload.contentHash);
+      else
+      {
+        printf("Need to upload photo %s as %s\n", upload.filePath.c_str(), upload.title.c_str());
+        uploadedPhotos[upload.title] = "-";
+      }
+    }
+
+    uploadPool.finish();
+    for (const auto& uploaded : uploadPool.uploadedPhotos())
+      uploadedPhotos.insert(uploaded);
+    for (const auto& added : uploadPool.photosAddedToSet())
+    {
+      addedToSet.insert(added.first);
+      photosInSet.add(added.first, added.second);
+    }
+    // Uploads that failed must not keep their titles taken
+    photosInSet.releaseTitles();
+  }
+
+  phase.next("delete/download");
+  atomic<int> downloaded{0};
+  int deleted = 0;
+  Downloader downloader(options.jobs);
+  auto photo = photosInSet.begin();
+  while (photo != photosInSet.end())
+  {
+    auto entry = *photo;
+    const auto& photoId = entry.first;
+    const auto& info = entry.second;
+    if (!photoExistingInFolder(photosInFolder, contentHashesInFolder, info))
+    {
+      if (options.removeNonExisting)
       {
-        printf("Starting to download photo/video file '%s' ...", filePath.c_str());
-        fflush(stdout);
-        if (downloadFile(downloadUrl, filePath))
+        if (!dryRun)
+        {
+          printf("Photo/video %s not existing in folder anymore - deleting\n", info.title.c_str());
+          if (auto ret = limitedApiCall("flickr.photos.delete", [&] { return flickcurl_photos_delete(fc, photoId.c_str()); }))
+            printf("ERROR: Unable to delete photo/video %s (id=%s): %d\n", info.title.c_str(), photoId.c_str(), ret);
+          else
+          {
+            ++deleted;
+            photo = photosInSet.erase(photo);
+            continue;
+          }
+        }
+        else
         {
-          printf("Done\n");
-          return true;
+          printf("Photo/video %s not existing in folder anymore - need to delete it\n", info.title.c_str());
+          if (plan)
+            plan->deletes.push_back({photoId, info.title});
+          ++deleted;
+          photo = photosInSet.erase(photo);
+          continue;
         }
+      }
+      else if (options.downloadNonExisting && photosInFolder.count(info.title))
+        printf("Photo/video %s is changed in folder, not downloading the version in Flickr\n", info.title.c_str());
+      else if (options.downloadNonExisting)
+      {
+        downloadPhoto(fc, downloader, photoId, info, info.title, folder, [&downloaded] { ++downloaded; });
+        if (dryRun && plan)
+          plan->downloads.push_back({photoId, info});
+      }
+      else
+        printf("WARNING: Photo/video %s not existing in folder anymore, specify -r to remove or -d to download these\n", info.title.c_str());
+    }
+    ++photo;
+  }
+  downloader.finish();
+
+  phase.next("duplicates");
+  for (const auto& duplicate : findDuplicates(photosInSet))
+  {
+    auto photo = photosInSet.find(duplicate.photoId);
+    auto photoTitle = photo->second.title;
+    auto title = photoTitle.c_str();
+    if (options.removeDuplicates)
+    {
+      if (!dryRun)
+      {
+        printf("Removing duplicate of photo/video file '%s' (id=%s)!\n", title, duplicate.photoId.c_str());
+        if (auto ret = limitedApiCall("flickr.photos.delete", [&] { return flickcurl_photos_delete(fc, duplicate.photoId.c_str()); }))
+          printf("ERROR: Unable to delete photo/video %s (id=%s): %d\n", title, duplicate.photoId.c_str(), ret);
         else
-          printf("Failed!\n");
+        {
+          ++deleted;
+          photosInSet.erase(photo);
+        }
       }
       else
       {
-        printf("Need to download photo/video file '%s'\n", filePath.c_str());
-        return true;
+        printf("Need to remove duplicate of photo/video file '%s' (id=%s)\n", title, duplicate.photoId.c_str());
+        if (plan)
+          plan->deletes.push_back({duplicate.photoId, photoTitle});
+        ++deleted;
+        photosInSet.erase(photo);
       }
     }
+    else
+      printf("WARNING: duplicates of photo/video file title '%s' found (id=%s && id=%s)!\n", title,
+             duplicate.survivorId.c_str(), duplicate.photoId.c_str());
+  }
+
+  phase.next("reorder");
+  auto listingOrderKnown = true;
+  if (options.sortByTitle && !photosInSet.empty())
+  {
+    vector<pair<string,string>> photosInSetOrder;
+    for (auto photo : photosInSet.inListingOrder())
+    {
+      auto entry = *photo;
+      photosInSetOrder.emplace_back(move(entry.first), move(entry.second.title));
+    }
+    vector<string> sortedIds;
+    if (reorderByTitle(fc, setId, photosInSetOrder, addedToSet, &sortedIds))
+      photosInSet.setListingOrder(sortedIds);
+    else if (!dryRun)
+      listingOrderKnown = false;
+
+    if (dryRun && plan)
+    {
+      // Photos/videos added to the set are appended again when the plan is applied
+      plan->reorder = true;
+      for (auto& photo : photosInSetOrder)
+        if (!addedToSet.count(photo.first))
+          plan->reorderedPhotos.push_back(move(photo));
+    }
   }
-  return false;
+
+  syncSummary summary{photosInFolder.size(), uploadedPhotos.size(), deleted, downloaded.load(), photosInSet.size()};
+  printf("FlickrSync finished: Photos/videos in folder=%ld, Uploaded=%ld, Deleted=%d, Downloaded=%d, Photos/videos in Flickr set=%ld\n",
+         summary.inFolder,
+         summary.uploaded,
+         summary.deleted,
+         summary.downloaded,
+         summary.inSet);
+
+  if (plan)
+  {
+    plan->folderPath = folderPath;
+    plan->setName = setName;
+    plan->setId = setId;
+    plan->setPhotoCount = setPhotoCount;
+  }
+
+  phase.next("manifest");
+  if (!dryRun)
+  {
+    // Uploaded photos are known only by title until Flickr is listed again, the order of a set that
+    // failed to reorder is not known either
+    manifest.setId = setId;
+    manifest.setPhotoCount = uploadedPhotos.empty() && listingOrderKnown ? photoCountInSetList(photosInSet) : -1;
+    manifest.photos = move(photosInSet);
+    if (!manifest.save(manifestPath, folder.path().toStdString()))
+      printf("WARNING: Unable to save sync manifest '%s'\n", manifestPath.c_str());
+    photosInSet = move(manifest.photos);
+  }
+
+  if (watched)
+  {
+    watched->path = folder.path().toStdString();
+    watched->setName = setName;
+    watched->setId = setId;
+    watched->photosInSet = move(photosInSet);
+    if (dryRun)
+      for (const auto& upload : plannedUploads)
+        watched->dryRunUploads.insert(upload.title);
+  }
+  return summary;
 }
 
-bool titleExistingInSet(const map<string,photoInfo>& photos, const string& title)
+// Syncs each subfolder of root folder to photoset of the same name, options.jobs folders at a time
+syncSummary syncFolders(const QDir& root, const map<string,photosetEntry>& photosets, const syncOptions& options,
+                        vector<watchedFolder>* watched = nullptr, vector<syncPlan>* plans = nullptr)
 {
-  for (const auto& photo : photos)
-    if (photo.second.title == title)
-      return true;
-  return false;
+  WorkQueue<QString> folders;
+  for (const auto& entry : root.entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot))
+    folders.push(entry.filePath());
+  folders.close();
+
+  // Concurrency comes from syncing several folders at a time
+  auto folderOptions = options;
+  folderOptions.jobs = 1;
+  folderOptions.listingJobs = 1;
+  folderOptions.renameJobs = 1;
+
+  // One session for each folder worker, created before the workers start
+  vector<flickcurl*> sessions;
+  for (unsigned i = 0; i < options.jobs; ++i)
+    if (auto session = newFlickcurlSession())
+      sessions.emplace_back(session);
+    else
+      printf("ERROR: Unable to create Flickr session for syncing folders\n");
+
+  mutex summaryMutex;
+  syncSummary total{0, 0, 0, 0, 0};
+  int syncedFolders{0};
+  vector<thread> workers;
+  for (auto session : sessions)
+    workers.emplace_back([&, session]()
+    {
+      QString folderPath;
+      while (folders.pop(&folderPath))
+      {
+        watchedFolder folder;
+        syncPlan plan;
+        auto summary = syncFolder(session, QDir(folderPath), photosets, folderOptions, watched ? &folder : nullptr,
+                                  plans ? &plan : nullptr);
+        lock_guard<mutex> lock(summaryMutex);
+        if (watched && !folder.path.empty())
+          watched->push_back(move(folder));
+        if (plans && !plan.folderPath.empty())
+          plans->push_back(move(plan));
+        total.inFolder += summary.inFolder;
+        total.uploaded += summary.uploaded;
+        total.deleted += summary.deleted;
+        total.downloaded += summary.downloaded;
+        total.inSet += summary.inSet;
+        ++syncedFolders;
+      }
+    });
+  for (auto& worker : workers)
+    worker.join();
+  for (auto session : sessions)
+    flickcurl_free(session);
+
+  printf("FlickrSync finished for %d folders: Photos/videos in folders=%ld, Uploaded=%ld, Deleted=%d, Downloaded=%d, Photos/videos in Flickr sets=%ld\n",
+         syncedFolders,
+         total.inFolder,
+         total.uploaded,
+         total.deleted,
+         total.downloaded,
+         total.inSet);
+  return total;
+}
+
+// Photos to rename or delete that still have the title they had when planning. Many photos are
+// checked by listing the set, a few by looking each of them up.
+static unordered_set<string> verifyPlannedPhotos(flickcurl* fc, const syncPlan& plan, unsigned jobs)
+{
+  map<string,string> plannedTitles;
+  for (const auto& photo : plan.deletes)
+    plannedTitles[photo.photoId] = photo.title;
+  // Planned deletes of renamed photos have the new title
+  for (const auto& change : plan.renames)
+    plannedTitles[change.photoId] = change.oldTitle;
+
+  unordered_set<string> verified;
+  auto listingCalls = (plan.setPhotoCount + LISTING_PAGE_SIZE - 1) / LISTING_PAGE_SIZE;
+  if (plan.setPhotoCount >= 0 && plannedTitles.size() > static_cast<size_t>(listingCalls))
+  {
+    PhotoSet photosInSet;
+    if (listSetPhotos(fc, plan.setId, plan.setPhotoCount, max(jobs, DEFAULT_LISTING_JOBS), &photosInSet))
+      for (const auto& planned : plannedTitles)
+      {
+        auto photo = photosInSet.find(planned.first);
+        if (photo != photosInSet.end() && photo->second.title == planned.second)
+          verified.insert(planned.first);
+      }
+    return verified;
+  }
+
+  vector<const pair<const string,string>*> photos;
+  for (const auto& planned : plannedTitles)
+    photos.push_back(&planned);
+  mutex verifiedMutex;
+  forEachConcurrently(fc, photos.size(), max(jobs, DEFAULT_LISTING_JOBS), [&](flickcurl* session, size_t i)
+  {
+    const auto& photoId = photos[i]->first;
+    if (auto photo = limitedApiCall("flickr.photos.getInfo", [&] { return flickcurl_photos_getInfo(session, photoId.c_str()); }))
+    {
+      auto matches = photoField(photo, PHOTO_FIELD_title) == photos[i]->second;
+      flickcurl_free_photo(photo);
+      lock_guard<mutex> lock(verifiedMutex);
+      if (matches)
+        verified.insert(photoId);
+    }
+  });
+  return verified;
 }
 
-bool isDateBasedName(const string& title)
+// Applies plan recorded by an earlier dry run, without listing the folder and the set again
+static syncSummary applyPlan(flickcurl* fc, const syncPlan& plan, unsigned jobs, const PhotoIndex* accountIndex)
 {
-  // Try to match YYYYMMDD-HHMMSS-n..
-  return QRegularExpression("^\\d\\d\\d\\d\\d\\d\\d\\d-\\d\\d\\d\\d\\d\\d(-\\d*)?$").match(
-        QString::fromStdString(title), 0, QRegularExpression::PartialPreferCompleteMatch).hasMatch();
+  printf("Applying sync plan of folder '%s' to Flickr photoset '%s'...\n", plan.folderPath.c_str(),
+         plan.setName.c_str());
+  auto verified = verifyPlannedPhotos(fc, plan, jobs);
+
+  vector<titleChange> renames;
+  for (const auto& change : plan.renames)
+    if (verified.count(change.photoId))
+      renames.push_back(change);
+    else
+      printf("WARNING: Photo %s (id=%s) has changed since planning, not setting its title\n",
+             change.oldTitle.c_str(), change.photoId.c_str());
+  map<string,string> newTitles;
+  for (const auto& change : renames)
+    newTitles[change.photoId] = change.newTitle;
+  for (const auto& change : applyTitleChanges(fc, renames, max(jobs, DEFAULT_RENAME_JOBS)))
+    newTitles.erase(change.photoId);
+
+  auto setId = plan.setId;
+  vector<plannedUpload> uploads;
+  for (const auto& upload : plan.uploads)
+    if (!access(upload.filePath.c_str(), R_OK))
+      uploads.push_back(upload);
+    else
+      printf("WARNING: Photo/video %s not existing in folder anymore, not uploading\n", upload.filePath.c_str());
+  map<string,photoInfo> addedToSet;
+  if (accountIndex)
+    addedToSet = reuseIndexedPhotos(fc, *accountIndex, plan.setName, &setId, &uploads);
+  auto uploaded = addedToSet.size();
+  {
+    UploadPool uploadPool(jobs, plan.setName, &setId);
+    for (const auto& upload : uploads)
+      uploadPool.upload(upload.title, upload.filePath, upload.contentHash);
+    uploadPool.finish();
+    uploaded += uploadPool.uploadedPhotos().size();
+    for (const auto& added : uploadPool.photosAddedToSet())
+      addedToSet.insert(added);
+  }
+
+  vector<const plannedDelete*> deletes;
+  for (const auto& photo : plan.deletes)
+    if (verified.count(photo.photoId))
+      deletes.push_back(&photo);
+    else
+      printf("WARNING: Photo/video %s (id=%s) has changed since planning, not deleting it\n",
+             photo.title.c_str(), photo.photoId.c_str());
+  atomic<int> deleted{0};
+  forEachConcurrently(fc, deletes.size(), jobs, [&](flickcurl* session, size_t i)
+  {
+    const auto& photo = *deletes[i];
+    printf("Deleting photo/video %s (id=%s)\n", photo.title.c_str(), photo.photoId.c_str());
+    if (auto ret = limitedApiCall("flickr.photos.delete", [&] { return flickcurl_photos_delete(session, photo.photoId.c_str()); }))
+      printf("ERROR: Unable to delete photo/video %s (id=%s): %d\n", photo.title.c_str(), photo.photoId.c_str(), ret);
+    else
+      ++deleted;
+  });
+
+  atomic<int> downloaded{0};
+  {
+    Downloader downloader(jobs);
+    QDir folder(plan.folderPath.c_str());
+    for (const auto& download : plan.downloads)
+      downloadPhoto(fc, downloader, download.photoId, download.info, download.info.title, folder,
+                    [&downloaded] { ++downloaded; });
+    downloader.finish();
+  }
+
+  if (plan.reorder && !setId.empty())
+  {
+    // Planned titles are used for renamed photos only when the rename succeeded
+    map<string,string> oldTitles;
+    for (const auto& change : plan.renames)
+      if (!newTitles.count(change.photoId))
+        oldTitles[change.photoId] = change.oldTitle;
+    vector<pair<string,string>> photosInSetOrder;
+    unordered_set<string> plannedIds;
+    for (const auto& photo : plan.reorderedPhotos)
+    {
+      auto oldTitle = oldTitles.find(photo.first);
+      photosInSetOrder.emplace_back(photo.first, oldTitle == oldTitles.end() ? photo.second : oldTitle->second);
+      plannedIds.insert(photo.first);
+    }
+    unordered_set<string> addedIds;
+    for (const auto& added : addedToSet)
+    {
+      addedIds.insert(added.first);
+      // Plans written by earlier versions may list the added photos/videos already
+      if (!plannedIds.count(added.first))
+        photosInSetOrder.emplace_back(added.first, added.second.title);
+    }
+    vector<string> sortedIds;
+    reorderByTitle(fc, setId, photosInSetOrder, addedIds, &sortedIds);
+  }
+
+  // Set listing in the sync manifest does not include the applied changes
+  SyncManifest manifest;
+  auto manifestPath = plan.folderPath + '/' + MANIFEST_FILE_NAME;
+  if (manifest.load(manifestPath))
+  {
+    manifest.setPhotoCount = -1;
+    manifest.save(manifestPath, plan.folderPath);
+  }
+
+  syncSummary summary{0, uploaded, deleted.load(), downloaded.load(), 0};
+  printf("FlickrSync plan applied: Renamed=%zu, Uploaded=%ld, Deleted=%d, Downloaded=%d\n", newTitles.size(),
+         summary.uploaded, summary.deleted, summary.downloaded);
+  return summary;
 }
 
-string correctNameBasedOnDateTaken(const string& dateTaken)
+const string PREFETCHED_PHOTO_SUFFIX{".next"};
+
+static bool downloadRandomPhoto(flickcurl* fc, const string& setName, const string& fileName)
 {
-  if (dateTaken.length() < 19) // date_taken is in format YYYY-MM-DD HH:MM:SS
-    return "";
-  return dateTaken.substr(0, 4) + dateTaken.substr(5, 2) + dateTaken.substr(8, 2) + "-" +
-      dateTaken.substr(11, 2) + dateTaken.substr(14, 2) + dateTaken.substr(17, 2);
+  randomPhoto photo;
+  if (!pickRandomPhoto(fc, setName, &photo))
+  {
+    printf("ERROR: No photo/video found to download%s%s\n", setName.empty() ? "" : " from album ", setName.c_str());
+    return false;
+  }
+
+  printf("Downloading random photo/video file '%s/%s'\n", photo.setTitle.c_str(), photo.info.title.c_str());
+  bool success{false};
+  Downloader downloader(1);
+  downloadPhoto(fc, downloader, photo.photoId, photo.info, fileName, QDir("."), [&success] { success = true; });
+  downloader.finish();
+  return success;
 }
 
-string addSuffixWhenDuplicateNamesExist(const string& title, const map<string,photoInfo>& photos)
+// Moves photo prefetched by the previous run in place of fileName (with the prefetched file extension)
+static bool usePrefetchedPhoto(const string& fileName)
 {
-  string correctedTitle = title;
-  int prefix = 0;
-  while (titleExistingInSet(photos, correctedTitle))
-    correctedTitle = title + "-" + to_string(++prefix);
-  return correctedTitle;
+  auto prefix = fileName + PREFETCHED_PHOTO_SUFFIX + ".";
+  glob_t prefetched;
+  if (glob((prefix + "*").c_str(), 0, nullptr, &prefetched))
+    return false;
+
+  auto used = false;
+  for (size_t i = 0; i < prefetched.gl_pathc && !used; ++i)
+  {
+    string path = prefetched.gl_pathv[i];
+    if (path.size() > PARTIAL_DOWNLOAD_SUFFIX.size() &&
+        path.compare(path.size() - PARTIAL_DOWNLOAD_SUFFIX.size(), string::npos, PARTIAL_DOWNLOAD_SUFFIX) == 0)
+      continue;
+    auto targetPath = fileName + '.' + path.substr(prefix.size());
+    used = rename(path.c_str(), targetPath.c_str()) == 0;
+    if (used)
+      printf("Using prefetched photo/video file '%s'\n", targetPath.c_str());
+  }
+  globfree(&prefetched);
+  return used;
 }
 
 int main(int argc, char *argv[])
@@ -226,13 +1166,18 @@ int main(int argc, char *argv[])
   int rc = 0;
   int help = 0;
   int i;
-  bool removeNonExisting = false;
-  bool removeDuplicates = false;
-  bool downloadNonExisting = false;
-  bool sortByTitle = false;
-  bool renameByDateTaken = false;
+  syncOptions options;
+  bool recursive = false;
+  bool watch = false;
   bool getRandomPhoto = false;
+  bool prefetch = false;
   string randomPhotoFileName;
+  string statsFileName;
+  string planOutFileName;
+  string applyPlanFileName;
+  bool useAccountIndex{false};
+  int64_t maxDownloadRate{0};
+  int64_t downloadBudget{0};
 
   flickcurl_init();
 
@@ -252,6 +1197,7 @@ int main(int argc, char *argv[])
       rc = 1;
       goto tidy;
     }
+    setServiceUris(fc);
   }
   else
   {
@@ -307,23 +1253,56 @@ int main(int argc, char *argv[])
       break;
 
     case 'd':
-      downloadNonExisting = true;
+      options.downloadNonExisting = true;
       break;
 
     case 'r':
-      removeNonExisting = true;
+      options.removeNonExisting = true;
       break;
 
     case 'f':
-      removeDuplicates = true;
+      options.removeDuplicates = true;
       break;
 
     case 's':
-      sortByTitle = true;
+      options.sortByTitle = true;
       break;
 
     case 'o':
-      renameByDateTaken = true;
+      options.renameByDateTaken = true;
+      break;
+
+    case 'T':
+      if (optarg)
+      {
+        titlePolicy = TitlePolicy(optarg);
+        if (!titlePolicy.valid())
+        {
+          fprintf(stderr, "%s: Invalid title template '%s'\n", program, optarg);
+          rc = 1;
+          goto tidy;
+        }
+      }
+      break;
+
+    case 'F':
+      options.fullSync = true;
+      break;
+
+    case 'c':
+      options.matchContent = true;
+      break;
+
+    case 'i':
+      useAccountIndex = true;
+      break;
+
+    case 'R':
+      recursive = true;
+      break;
+
+    case 'w':
+      watch = true;
       break;
 
     case 'g':
@@ -331,244 +1310,134 @@ int main(int argc, char *argv[])
       if (optarg)
         randomPhotoFileName = optarg;
       break;
+
+    case 'P':
+      prefetch = true;
+      break;
+
+    case 'j':
+      if (optarg && atoi(optarg) > 0)
+        options.jobs = atoi(optarg);
+      break;
+
+    case 'S':
+      if (optarg)
+        statsFileName = optarg;
+      break;
+
+    case 'B':
+      if (optarg && atoi(optarg) > 0)
+        apiRateLimiter.setBudget(atoi(optarg));
+      break;
+
+    case 'p':
+      dryRun = true;
+      if (optarg)
+        planOutFileName = optarg;
+      break;
+
+    case 'a':
+      if (optarg)
+        applyPlanFileName = optarg;
+      break;
+
+    case 'z':
+      if (optarg)
+      {
+        downloadSizes.clear();
+        string labels = optarg;
+        for (size_t start = 0, end; start < labels.size(); start = end + 1)
+        {
+          end = min(labels.find(',', start), labels.size());
+          if (end > start)
+            downloadSizes.push_back(labels.substr(start, end - start));
+        }
+      }
+      break;
+
+    case 'L':
+      if (optarg && atoll(optarg) > 0)
+        maxDownloadRate = atoll(optarg) * 1024;
+      break;
+
+    case 'b':
+      if (optarg && atoll(optarg) > 0)
+        downloadBudget = atoll(optarg) * 1024 * 1024;
+      break;
     }
 
   }
 
   argv += optind;
   argc -= optind;
+  setDownloadLimits(maxDownloadRate, downloadBudget);
+  options.listingJobs = max(options.jobs, DEFAULT_LISTING_JOBS);
+  options.renameJobs = max(options.jobs, DEFAULT_RENAME_JOBS);
 
   if (help)
   {
     printHelpString();
     exit(-1);
   }
+  else if (!applyPlanFileName.empty() && dryRun)
+  {
+    // Applying makes the changes right away, the plan written by --plan-out is its dry run
+    fprintf(stderr, "%s: ERROR: --apply can not be combined with --dry-run or --plan-out\n", program);
+    rc = 1;
+  }
   else
   {
-    if (argc)
+    PhotoIndex accountIndex;
+    if (useAccountIndex && !options.matchContent)
+      printf("WARNING: -i needs -c to find photos/videos by content, not using the photo index of Flickr account\n");
+    else if (useAccountIndex && (argc || !applyPlanFileName.empty()))
+    {
+      PhaseTimer phase("index");
+      if (accountIndex.refresh(fc, options.fullSync))
+        options.accountIndex = &accountIndex;
+      else
+        printf("WARNING: Photo index of Flickr account not available, uploading all photos/videos\n");
+    }
+
+    if (!applyPlanFileName.empty())
+    {
+      vector<syncPlan> plans;
+      if (!loadPlans(applyPlanFileName, &plans))
+      {
+        fprintf(stderr, "%s: ERROR: Unable to read sync plan '%s'\n", program, applyPlanFileName.c_str());
+        rc = 1;
+        goto tidy;
+      }
+      for (const auto& plan : plans)
+        applyPlan(fc, plan, options.jobs, options.accountIndex);
+    }
+    else if (argc)
     {
       QDir folder(argv[0]);
       if (folder.exists())
       {
-        string setName = folder.dirName().toStdString();
-        printf("Starting to sync photos/videos from folder '%s' to Flickr...\n", argv[0]);
-        map<string,string> photosInFolder;
-        for (const auto& entry : folder.entryInfoList())
-          if (entry.isFile())
-          {
-            string baseName = entry.baseName().toLower().toStdString();
-            if (photosInFolder.count(baseName) != 0)
-            {
-              printf("ERROR: Photos/videos with duplicate basenames found (%s AND %s) - can not sync correctly\n",
-                     entry.filePath().toStdString().c_str(), photosInFolder[baseName].c_str());
-            }
-            else
-              photosInFolder[baseName] = entry.filePath().toStdString();
-          }
-
-        string setId;
-        if (auto photoset_list = flickcurl_photosets_getList(fc, nullptr))
-        {
-          for(int i = 0; photoset_list[i]; i++)
-            if (string(photoset_list[i]->title) == setName)
-            {
-              printf("Flickr photoset '%s' (id=%s) is already existing\n", setName.c_str(), photoset_list[i]->id);
-              setId = photoset_list[i]->id;
-            }
-          flickcurl_free_photosets(photoset_list);
-        }
-
-        map<string,photoInfo> photosInSet;
-        if (!setId.empty())
-        {
-          int page{1};
-          bool lastPage{false};
-          while (!lastPage)
-          {
-            if (auto photos = flickcurl_photosets_getPhotos(fc, setId.c_str(), "date_upload,date_taken,description", -1, 500, page))
-            {
-              unsigned photosInPage{0};
-              for (int i = 0; photos[i]; i++)
-              {
-                auto description = photos[i]->fields[PHOTO_FIELD_description].string;
-                photosInSet[photos[i]->id] = {photos[i]->fields[PHOTO_FIELD_title].string,
-                                              photos[i]->fields[PHOTO_FIELD_dates_taken].string,
-                                              description ? description : ""};
-                ++photosInPage;
-              }
-              flickcurl_free_photos(photos);
-              if (photosInPage < 500)
-                lastPage = true;
-              else
-                ++page;
-            }
-          }
-        }
-        if (renameByDateTaken && photosInSet.size())
-        {
-          for (const auto& photoFile : photosInSet)
-            if (!isDateBasedName(photoFile.second.title))
-            {
-              auto correctName = correctNameBasedOnDateTaken(photoFile.second.dateTaken);
-              if (!correctName.empty())
-              {
-                if (photoFile.second.title.substr(0, CORRECT_DATE_BASED_NAME_LENGTH) != correctName)
-                {
-                  correctName = addSuffixWhenDuplicateNamesExist(correctName, photosInSet);
-                  if (!dryRun)
-                  {
-                    printf("Setting photo title based on date taken %s => %s\n", photoFile.second.title.c_str(),
-                           correctName.c_str());
-                    if (auto ret = flickcurl_photos_setMeta(fc, photoFile.first.c_str(),
-                                                            correctName.c_str(),
-                                                            photoFile.second.dateTaken.c_str()))
-                      printf("ERROR: Unable to set photo %s title to %s: %d\n", photoFile.second.title.c_str(),
-                             correctName.c_str(), ret);
-                    else
-                      photosInSet[photoFile.first].title = correctName;
-                  }
-                  else
-                    printf("Need to set photo title based on date taken %s => %s\n", photoFile.second.title.c_str(),
-                           correctName.c_str());
-                }
-              }
-            }
-        }
-        map<string,string> uploadedPhotos;
-        for (const auto& photoFile : photosInFolder)
-          if (!titleExistingInSet(photosInSet, photoFile.first))
-          {
-            flickcurl_upload_params params;
-            memset(&params, '\0', sizeof(flickcurl_upload_params));
-            params.safety_level = 1;
-            params.content_type = 1;
-            params.hidden = 1;
-            params.is_family = 1;
-            params.title = photoFile.first.c_str();
-            params.photo_file = photoFile.second.c_str();
-
-            if (!dryRun)
-            {
-              printf("Uploading photo/video %s ...", params.photo_file);
-              fflush(stdout);
-              if (auto status = flickcurl_photos_upload_params(fc, &params))
-              {
-                printf("Done (id=%s)\n", status->photoid);
-                uploadedPhotos[photoFile.first] = status->photoid;
-                if (addToSet(fc, status->photoid, setName, &setId))
-                  photosInSet[status->photoid] = { photoFile.first, "", "" };
-                flickcurl_free_upload_status(status);
-              }
-              else
-                printf("Failed!\n");
-            }
-            else
-            {
-              printf("Need to upload photo %s\n", params.photo_file);
-              uploadedPhotos[photoFile.first] = "-";
-            }
-          }
-          else
-            printf("Photo/video %s is already existing in set, skipping\n", photoFile.first.c_str());
-
-        int downloaded = 0;
-        int deleted = 0;
-        auto photo = photosInSet.begin();
-        while (photo != photosInSet.end())
+        PhaseTimer phase("photosets");
+        auto photosets = listPhotosets(fc);
+        phase.next(nullptr);
+        vector<watchedFolder> watchedFolders;
+        vector<syncPlan> plans;
+        if (recursive)
+          syncFolders(folder, photosets, options, watch ? &watchedFolders : nullptr, &plans);
+        else
         {
-          if (photosInFolder.count(photo->second.title) == 0)
-          {
-            if (removeNonExisting)
-            {
-              if (!dryRun)
-              {
-                printf("Photo/video %s not existing in folder anymore - deleting\n", photo->second.title.c_str());
-                if (auto ret = flickcurl_photos_delete(fc, photo->first.c_str()))
-                  printf("ERROR: Unable to delete photo/video %s (id=%s): %d\n", photo->second.title.c_str(),
-                         photo->first.c_str(), ret);
-                else
-                {
-                  ++deleted;
-                  photo = photosInSet.erase(photo);
-                  continue;
-                }
-              }
-              else
-              {
-                printf("Photo/video %s not existing in folder anymore - need to delete it\n", photo->second.title.c_str());
-                ++deleted;
-                photo = photosInSet.erase(photo);
-                continue;
-              }
-            }
-            else if (downloadNonExisting)
-            {
-              if (downloadPhoto(photo->first, photo->second.title, folder))
-                ++downloaded;
-            }
-            else
-              printf("WARNING: Photo/video %s not existing in folder anymore, specify -r to remove or -d to download these\n", photo->second.title.c_str());
-          }
-          auto photosInSetClone = photosInSet;
-          auto clonedPhoto = photosInSetClone.begin();
-          while (clonedPhoto != photosInSetClone.end())
-          {
-            if (photo->first != clonedPhoto->first)
-            {
-              if (photo->second.title == clonedPhoto->second.title &&
-                  photo->second.dateTaken == clonedPhoto->second.dateTaken &&
-                  photo->second.description == clonedPhoto->second.description)
-              {
-                if (removeDuplicates && dryRun)
-                {
-                  printf("Removing duplicate of photo/video file '%s' (id=%s)!\n", clonedPhoto->second.title.c_str(), clonedPhoto->first.c_str());
-                  if (auto ret = flickcurl_photos_delete(fc, clonedPhoto->first.c_str()))
-                    printf("ERROR: Unable to delete photo/video %s (id=%s): %d\n", clonedPhoto->second.title.c_str(),
-                           clonedPhoto->first.c_str(), ret);
-                  else
-                  {
-                    ++deleted;
-                    clonedPhoto = photosInSetClone.erase(clonedPhoto);
-                    continue;
-                  }
-                }
-                else
-                  printf("WARNING: duplicates of photo/video file title '%s' found (id=%s && id=%s)!\n", clonedPhoto->second.title.c_str(), photo->first.c_str(), clonedPhoto->first.c_str());
-              }
-            }
-            ++clonedPhoto;
-          }
-          ++photo;
+          watchedFolder watched;
+          plans.emplace_back();
+          syncFolder(fc, folder, photosets, options, watch ? &watched : nullptr, &plans.back());
+          if (watch && !watched.path.empty())
+            watchedFolders.push_back(move(watched));
         }
-
-        if (sortByTitle && !photosInSet.empty())
+        if (!planOutFileName.empty() && !savePlans(planOutFileName, plans))
         {
-          map<string,string> reorderedIds;
-          for (const auto& photo : photosInSet)
-            reorderedIds[photo.second.title] = photo.first;
-
-          vector<const char*> reorderedIdsVector;
-          for (const auto& id : reorderedIds)
-            reorderedIdsVector.emplace_back(id.second.c_str());
-          reorderedIdsVector.emplace_back(nullptr);
-
-          if (!dryRun)
-          {
-            if (auto ret = flickcurl_photosets_reorderPhotos(fc, setId.c_str(), reorderedIdsVector.data()))
-              printf("ERROR: Unable to reorder photoset '%s' by photo/video titles: %d\n", setId.c_str(), ret);
-            else
-              printf("Photoset reordered '%s' by photo/video titles\n", setId.c_str());
-          }
-          else
-            printf("Will reorder photoset '%s' by photo/video titles\n", setId.c_str());
+          fprintf(stderr, "%s: ERROR: Unable to write sync plan '%s'\n", program, planOutFileName.c_str());
+          rc = 1;
         }
-
-        printf("FlickrSync finished: Photos/videos in folder=%ld, Uploaded=%ld, Deleted=%d, Downloaded=%d, Photos/videos in Flickr set=%ld\n",
-               photosInFolder.size(),
-               uploadedPhotos.size(),
-               deleted,
-               downloaded,
-               photosInSet.size());
+        if (watch)
+          watchFolders(watchedFolders, options.jobs, options.matchContent);
       }
     }
     if (getRandomPhoto)
@@ -577,53 +1446,19 @@ int main(int argc, char *argv[])
       if (argc)
         setName = argv[0];
 
-      random_device r;
-      default_random_engine re{r()};
-
-      map<string,string> setIds;
-      if (auto photoset_list = flickcurl_photosets_getList(fc, nullptr))
-      {
-        for(int i = 0; photoset_list[i]; i++)
-          if (setName.empty() || string(photoset_list[i]->title) == setName)
-            setIds[photoset_list[i]->id] = photoset_list[i]->title;
-        flickcurl_free_photosets(photoset_list);
-      }
-      auto setIdsSize = setIds.size();
-      auto setIdIterator = setIds.begin();
-      if (setIds.size() > 1)
-      {
-        uniform_int_distribution<size_t> photoIdsRandom(0, setIdsSize-1);
-        auto randomPhotoIdsIndex = photoIdsRandom(re);
-        advance(setIdIterator, randomPhotoIdsIndex);
-      }
-
-      map<string,photoInfo> photosSet;
-      if (setIdIterator != setIds.end())
-      {
-        if (auto photos = flickcurl_photosets_getPhotos(fc, setIdIterator->first.c_str(), "date_upload,date_taken,description", -1, -1, -1))
-        {
-          for (int i = 0; photos[i]; i++)
-          {
-            auto description = photos[i]->fields[PHOTO_FIELD_description].string;
-            photosSet[photos[i]->id] = {photos[i]->fields[PHOTO_FIELD_title].string,
-                                        photos[i]->fields[PHOTO_FIELD_dates_taken].string,
-                                        description ? description : ""};
-          }
-          flickcurl_free_photos(photos);
-        }
-      }
-      QDir folder(".");
-      auto photoSetSize = photosSet.size();
-      auto photoIterator = photosSet.begin();
-      uniform_int_distribution<size_t> photosetRandom(0, photoSetSize-1);
-      auto randomPhotoIndex = photosetRandom(re);
-      advance(photoIterator, randomPhotoIndex);
-      printf("Downloading random photo/video file '%s/%s'\n", setIdIterator->second.c_str(), photoIterator->second.title.c_str());
-      downloadPhoto(photoIterator->first, randomPhotoFileName, folder);
+      if (!(prefetch && usePrefetchedPhoto(randomPhotoFileName)) &&
+          !downloadRandomPhoto(fc, setName, randomPhotoFileName))
+        rc = 1;
+      // Next photo is downloaded ahead, so the next run can show it without waiting for Flickr
+      if (prefetch)
+        downloadRandomPhoto(fc, setName, randomPhotoFileName + PREFETCHED_PHOTO_SUFFIX);
     }
   }
 
 tidy:
+  if (!statsFileName.empty() && !syncStats.writeJson(statsFileName))
+    fprintf(stderr, "%s: ERROR: Unable to write statistics to '%s'\n", program, statsFileName.c_str());
+
   if(fc)
     flickcurl_free(fc);
 
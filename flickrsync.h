@@ -0,0 +1,49 @@
+/*
+ *
+ * flickrsync utility - Declarations shared between flickrsync modules
+ *
+ */
+
+#ifndef FLICKRSYNC_H
+#define FLICKRSYNC_H
+
+#include <functional>
+#include <string>
+
+#include <flickcurl.h>
+
+struct photoInfo {
+  std::string title;
+  std::string dateTaken;
+  std::string description;
+  std::string media;
+  std::string originalFormat;
+  // Original source URL is built from server and original secret, see originalPhotoUrl
+  std::string server;
+  std::string originalSecret;
+  std::string contentHash;
+};
+
+extern const char* PHOTO_LIST_EXTRAS;
+
+extern int verbose;
+extern const char* program;
+extern bool dryRun;
+extern flickcurl *fc;
+
+std::string flickcurlConfigFile();
+flickcurl* newFlickcurlSession();
+// Runs work for indexes 0..count-1 with up to jobs sessions concurrently, fc is used as one of them
+void forEachConcurrently(flickcurl* fc, size_t count, unsigned jobs,
+                         const std::function<void(flickcurl* session, size_t index)>& work);
+std::string createPhotoSet(flickcurl* fc, const std::string& name, const std::string& primaryPhotoId);
+bool addToSet(flickcurl* fc, const std::string& photoId, const std::string& setName, std::string* setId);
+// Photo/video title for local file: file name up to the first dot in lowercase
+std::string titleFromFileName(const std::string& fileName);
+photoInfo photoInfoFromListing(const flickcurl_photo* photo);
+// Source URL of photo original, empty when not known from the listing
+std::string originalPhotoUrl(const std::string& photoId, const photoInfo& info);
+std::string uploadPhoto(flickcurl* fc, const std::string& title, const std::string& filePath,
+                        const std::string& contentHash);
+
+#endif // FLICKRSYNC_H
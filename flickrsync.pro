@@ -9,4 +9,48 @@ INCLUDEPATH += /usr/include/libxml2
 LIBS += -lflickcurl -lxml2 -lcurl
 
 SOURCES += \
-    flickrsync.cpp
+    contenthash.cpp \
+    downloader.cpp \
+    duplicates.cpp \
+    exifdate.cpp \
+    flickrsync.cpp \
+    manifest.cpp \
+    photoindex.cpp \
+    photoset.cpp \
+    randomphoto.cpp \
+    ratelimiter.cpp \
+    renamer.cpp \
+    scanner.cpp \
+    setlisting.cpp \
+    stats.cpp \
+    stringarena.cpp \
+    syncplan.cpp \
+    titleorder.cpp \
+    titlepolicy.cpp \
+    uploadpool.cpp \
+    watcher.cpp
+
+HEADERS += \
+    binaryfile.h \
+    contenthash.h \
+    downloader.h \
+    duplicates.h \
+    exifdate.h \
+    flickrsync.h \
+    indextable.h \
+    manifest.h \
+    photoindex.h \
+    photoset.h \
+    randomphoto.h \
+    ratelimiter.h \
+    renamer.h \
+    scanner.h \
+    setlisting.h \
+    stats.h \
+    stringarena.h \
+    syncplan.h \
+    titleorder.h \
+    titlepolicy.h \
+    uploadpool.h \
+    watcher.h \
+    workqueue.h
@@ -0,0 +1,123 @@
+/*
+ *
+ * flickrsync utility - Open addressing hash table of indexes into a flat array
+ *
+ */
+
+#ifndef INDEXTABLE_H
+#define INDEXTABLE_H
+
+#include <stdint.h>
+
+#include <vector>
+
+// Hash table holding only 32-bit indexes, the keys stay in the array the indexes point to.
+// Callers pass the hash of the key and a function telling whether the element at an index has
+// the key, and for growing the table a function returning the hash of the element at an index.
+// Uses linear probing, slots hold index + 1 so that zero is empty.
+class IndexTable
+{
+public:
+  static const uint32_t NOT_FOUND{UINT32_MAX};
+
+  template <typename Matches>
+  uint32_t find(uint64_t hash, const Matches& matches) const
+  {
+    if (slots.empty())
+      return NOT_FOUND;
+    for (auto slot = position(hash); slots[slot] != EMPTY_SLOT; slot = (slot + 1) & mask())
+      if (slots[slot] != ERASED_SLOT && matches(slots[slot] - 1))
+        return slots[slot] - 1;
+    return NOT_FOUND;
+  }
+
+  template <typename HashOf>
+  void insert(uint64_t hash, uint32_t index, const HashOf& hashOf)
+  {
+    // Erased slots count as used, so that probing always ends at an empty slot
+    if ((used + 1) * MAX_LOAD_DENOMINATOR > slots.size() * MAX_LOAD_NUMERATOR)
+      rehash(live + 1, hashOf);
+    auto slot = position(hash);
+    while (slots[slot] != EMPTY_SLOT && slots[slot] != ERASED_SLOT)
+      slot = (slot + 1) & mask();
+    if (slots[slot] == EMPTY_SLOT)
+      ++used;
+    slots[slot] = index + 1;
+    ++live;
+  }
+
+  void erase(uint64_t hash, uint32_t index)
+  {
+    if (slots.empty())
+      return;
+    for (auto slot = position(hash); slots[slot] != EMPTY_SLOT; slot = (slot + 1) & mask())
+      if (slots[slot] == index + 1)
+      {
+        slots[slot] = ERASED_SLOT;
+        --live;
+        return;
+      }
+  }
+
+  // Makes room for count indexes without growing
+  template <typename HashOf>
+  void reserve(size_t count, const HashOf& hashOf)
+  {
+    if (count * MAX_LOAD_DENOMINATOR > slots.size() * MAX_LOAD_NUMERATOR)
+      rehash(count, hashOf);
+  }
+
+  void clear()
+  {
+    slots.clear();
+    used = live = 0;
+  }
+
+  size_t size() const { return live; }
+  size_t capacityBytes() const { return slots.capacity() * sizeof(uint32_t); }
+
+private:
+  static const uint32_t EMPTY_SLOT{0};
+  static const uint32_t ERASED_SLOT{UINT32_MAX};
+  static const size_t MAX_LOAD_NUMERATOR{7};
+  static const size_t MAX_LOAD_DENOMINATOR{10};
+
+  size_t mask() const { return slots.size() - 1; }
+
+  // Fibonacci hashing, spreads sequential keys like numeric photo ids over the table
+  size_t position(uint64_t hash) const { return (hash * 0x9e3779b97f4a7c15ULL) >> (64 - bits); }
+
+  template <typename HashOf>
+  void rehash(size_t count, const HashOf& hashOf)
+  {
+    size_t slotCount = 8;
+    bits = 3;
+    while (count * MAX_LOAD_DENOMINATOR > slotCount * MAX_LOAD_NUMERATOR)
+    {
+      slotCount *= 2;
+      ++bits;
+    }
+
+    // Zero filled, so all slots are empty
+    std::vector<uint32_t> oldSlots(slotCount);
+    oldSlots.swap(slots);
+    used = live = 0;
+    for (auto slot : oldSlots)
+      if (slot != EMPTY_SLOT && slot != ERASED_SLOT)
+      {
+        auto position = this->position(hashOf(slot - 1));
+        while (slots[position] != EMPTY_SLOT)
+          position = (position + 1) & mask();
+        slots[position] = slot;
+        ++used;
+        ++live;
+      }
+  }
+
+  std::vector<uint32_t> slots;
+  unsigned bits{0};
+  size_t used{0};
+  size_t live{0};
+};
+
+#endif // INDEXTABLE_H
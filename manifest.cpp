@@ -0,0 +1,145 @@
+/*
+ *
+ * flickrsync utility - Per-folder sync manifest for incremental syncs
+ *
+ */
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include "binaryfile.h"
+#include "manifest.h"
+
+using namespace std;
+
+const char* MANIFEST_FILE_NAME{".flickrsync.db"};
+
+const char MANIFEST_MAGIC[4]{'F', 'S', 'D', 'B'};
+const uint32_t MANIFEST_VERSION{5};
+const uint32_t MANIFEST_END_MARKER{0x454e4421};
+const int64_t MAX_SET_LISTING_AGE{24 * 60 * 60}; // seconds
+// Offset of the folder modification time, patched in place after saving
+const long MANIFEST_FOLDER_MTIME_OFFSET{sizeof(MANIFEST_MAGIC) + sizeof(MANIFEST_VERSION)};
+
+int64_t modificationTime(const string& path)
+{
+  struct stat status;
+  if (stat(path.c_str(), &status))
+    return 0;
+  return static_cast<int64_t>(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec;
+}
+
+bool SyncManifest::load(const string& path)
+{
+  auto file = fopen(path.c_str(), "rb");
+  if (!file)
+    return false;
+
+  BinaryReader reader(file);
+  char magic[sizeof(MANIFEST_MAGIC)];
+  auto valid = fread(magic, sizeof(magic), 1, file) == 1 &&
+      equal(magic, magic + sizeof(magic), MANIFEST_MAGIC) &&
+      reader.read<uint32_t>() == MANIFEST_VERSION;
+  if (valid)
+  {
+    folderMtime = reader.read<int64_t>();
+    auto fileCount = reader.read<uint32_t>();
+    // File name, size, mtime, inode and content hash
+    if (reader.fits(fileCount, 2 * STRING_MIN_BYTES + 3 * sizeof(int64_t)))
+      files.resize(fileCount);
+    for (auto& file : files)
+    {
+      file.fileName = reader.readString();
+      file.size = reader.read<int64_t>();
+      file.mtime = reader.read<int64_t>();
+      file.inode = reader.read<uint64_t>();
+      file.contentHash = reader.readString();
+    }
+
+    setId = reader.readString();
+    setPhotoCount = reader.read<int32_t>();
+    setListedAt = reader.read<int64_t>();
+    auto photoCount = reader.read<uint32_t>();
+    if (reader.fits(photoCount, STRING_MIN_BYTES + PHOTO_INFO_MIN_BYTES))
+      photos.reserve(photoCount);
+    for (uint32_t i = 0; i < photoCount && reader.ok; ++i)
+    {
+      auto photoId = reader.readString();
+      photos.add(photoId, reader.readPhotoInfo());
+    }
+    valid = reader.read<uint32_t>() == MANIFEST_END_MARKER && reader.ok;
+  }
+  fclose(file);
+
+  if (!valid)
+  {
+    *this = SyncManifest();
+    printf("WARNING: Ignoring invalid sync manifest '%s'\n", path.c_str());
+  }
+  return valid;
+}
+
+bool SyncManifest::save(const string& path, const string& folderPath)
+{
+  // Files are written either way, their content hashes are still valid while their inode, size and mtime are.
+  // The folder listing stays valid only when nothing but the manifest changes the folder while saving. Creating
+  // the temporary file and renaming it change the folder modification time, so it is read again right after each.
+  auto folderListingValid = folderMtime && folderMtime == modificationTime(folderPath);
+
+  auto tempPath = path + ".tmp";
+  auto file = fopen(tempPath.c_str(), "wb");
+  if (!file)
+    return false;
+  auto createdFolderMtime = modificationTime(folderPath);
+
+  BinaryWriter writer(file);
+  writer.ok = fwrite(MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC), 1, file) == 1;
+  writer.write(MANIFEST_VERSION);
+  writer.write(int64_t{0});
+  writer.write(static_cast<uint32_t>(files.size()));
+  for (const auto& file : files)
+  {
+    writer.write(file.fileName);
+    writer.write(file.size);
+    writer.write(file.mtime);
+    writer.write(file.inode);
+    writer.write(file.contentHash);
+  }
+
+  writer.write(setId);
+  writer.write(static_cast<int32_t>(setPhotoCount));
+  writer.write(setListedAt);
+  writer.write(static_cast<uint32_t>(photos.size()));
+  // Photos are written in listing order, which is restored when loading
+  for (auto photo : photos.inListingOrder())
+  {
+    writer.write(photo->first);
+    writer.write(photo->second);
+  }
+  writer.write(MANIFEST_END_MARKER);
+
+  auto saved = fclose(file) == 0 && writer.ok;
+  folderListingValid = folderListingValid && modificationTime(folderPath) == createdFolderMtime;
+  saved = saved && rename(tempPath.c_str(), path.c_str()) == 0;
+  if (!saved)
+  {
+    remove(tempPath.c_str());
+    return false;
+  }
+
+  if (!folderListingValid)
+  {
+    folderMtime = 0;
+    return true;
+  }
+
+  // Recorded only now, rewriting file content in place does not change the folder modification time again
+  folderMtime = modificationTime(folderPath);
+  if (auto file = fopen(path.c_str(), "r+b"))
+  {
+    saved = fseek(file, MANIFEST_FOLDER_MTIME_OFFSET, SEEK_SET) == 0 &&
+        fwrite(&folderMtime, sizeof(folderMtime), 1, file) == 1;
+    saved = fclose(file) == 0 && saved;
+  }
+  return saved;
+}
@@ -0,0 +1,65 @@
+/*
+ *
+ * flickrsync utility - Per-folder sync manifest for incremental syncs
+ *
+ */
+
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "flickrsync.h"
+#include "photoset.h"
+
+extern const char* MANIFEST_FILE_NAME;
+// Age in seconds after which the photoset is listed again even with unchanged photo count
+extern const int64_t MAX_SET_LISTING_AGE;
+
+struct localFile {
+  std::string fileName;
+  // Size, mtime (milliseconds since epoch) and inode are read when the file is hashed
+  int64_t size;
+  int64_t mtime;
+  uint64_t inode;
+  std::string contentHash;
+};
+
+// State of the folder and its photoset at the end of the last sync, stored in compact
+// binary form in the folder. The folder listing is valid while the folder modification
+// time is unchanged. The photoset listing is valid while the set photo count is unchanged,
+// for at most MAX_SET_LISTING_AGE, because the photo count does not include videos and does
+// not change when photos are edited on Flickr. The files are kept with their content hashes
+// even when the folder listing is not valid anymore.
+class SyncManifest
+{
+public:
+  bool load(const std::string& path);
+  // Saves manifest, the folder listing is recorded as valid only when the folder is still unchanged
+  // since folderMtime and nothing else changes it while the manifest is written. It is then recorded
+  // with the modification time after the manifest is written.
+  bool save(const std::string& path, const std::string& folderPath);
+
+  bool hasFolderListing(int64_t currentFolderMtime) const { return folderMtime && folderMtime == currentFolderMtime; }
+  bool hasSetListing(const std::string& currentSetId, int currentSetPhotoCount, int64_t now) const
+  {
+    return setPhotoCount >= 0 && setId == currentSetId && setPhotoCount == currentSetPhotoCount &&
+        now >= setListedAt && now - setListedAt < MAX_SET_LISTING_AGE;
+  }
+
+  int64_t folderMtime{0};
+  std::vector<localFile> files;
+
+  std::string setId;
+  int setPhotoCount{-1}; // -1 when the set listing is not known
+  int64_t setListedAt{0}; // seconds since epoch when the set was last listed from Flickr
+  PhotoSet photos;
+};
+
+// Modification time of file or folder in nanoseconds, 0 when not existing
+int64_t modificationTime(const std::string& path);
+
+#endif // MANIFEST_H
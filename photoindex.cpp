@@ -0,0 +1,264 @@
+/*
+ *
+ * flickrsync utility - Account-wide photo index for matching uploads across sets
+ *
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "binaryfile.h"
+#include "flickrsync.h"
+#include "photoindex.h"
+#include "ratelimiter.h"
+
+using namespace std;
+
+const char* PHOTO_INDEX_FILE_NAME{".flickrsync.index"};
+const char PHOTO_INDEX_MAGIC[4]{'F', 'S', 'I', 'X'};
+const uint32_t PHOTO_INDEX_VERSION{1};
+const int PHOTO_INDEX_PAGE_SIZE{500};
+
+struct PhotoIndex::header {
+  char magic[4];
+  uint32_t version;
+  uint32_t count;
+  uint32_t stringsSize;
+  // Latest upload date (seconds since epoch) in index, the next refresh lists photos uploaded since
+  int64_t lastUploadDate;
+};
+
+// Strings are NUL terminated, photos/videos without content hash have hash 0
+struct PhotoIndex::record {
+  uint64_t contentHash;
+  int64_t uploadDate;
+  uint32_t idOffset;
+  uint32_t titleOffset;
+};
+
+namespace {
+
+struct listedPhoto {
+  string title;
+  uint64_t contentHash;
+  int64_t uploadDate;
+};
+
+}
+
+static string photoIndexFile()
+{
+  auto home = getenv("HOME");
+  if (home)
+    return string(home) + '/' + PHOTO_INDEX_FILE_NAME;
+  return PHOTO_INDEX_FILE_NAME;
+}
+
+// Content hashes are 64-bit hex strings, 0 when not valid
+static uint64_t hashValue(const string& contentHash)
+{
+  if (contentHash.size() != 16 || contentHash.find_first_not_of("0123456789abcdef") != string::npos)
+    return 0;
+  return strtoull(contentHash.c_str(), nullptr, 16);
+}
+
+PhotoIndex::~PhotoIndex()
+{
+  close();
+}
+
+const PhotoIndex::header* PhotoIndex::fileHeader() const
+{
+  return static_cast<const header*>(data);
+}
+
+const PhotoIndex::record* PhotoIndex::records() const
+{
+  return reinterpret_cast<const record*>(static_cast<const char*>(data) + sizeof(header));
+}
+
+const char* PhotoIndex::strings() const
+{
+  return reinterpret_cast<const char*>(records() + fileHeader()->count);
+}
+
+size_t PhotoIndex::size() const
+{
+  return data ? fileHeader()->count : 0;
+}
+
+bool PhotoIndex::open(const string& path)
+{
+  close();
+  auto fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat status;
+  void* mapped = MAP_FAILED;
+  if (!fstat(fd, &status) && static_cast<size_t>(status.st_size) >= sizeof(header))
+    mapped = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapped == MAP_FAILED)
+    return false;
+
+  data = mapped;
+  length = status.st_size;
+  auto indexHeader = fileHeader();
+  auto expectedLength = sizeof(header) + static_cast<size_t>(indexHeader->count) * sizeof(record) +
+                        indexHeader->stringsSize;
+  if (memcmp(indexHeader->magic, PHOTO_INDEX_MAGIC, sizeof(PHOTO_INDEX_MAGIC)) ||
+      indexHeader->version != PHOTO_INDEX_VERSION || length != expectedLength ||
+      (indexHeader->stringsSize && strings()[indexHeader->stringsSize - 1]))
+  {
+    printf("WARNING: Ignoring invalid photo index '%s'\n", path.c_str());
+    close();
+    return false;
+  }
+  for (size_t i = 0; i < indexHeader->count; ++i)
+    if (records()[i].idOffset >= indexHeader->stringsSize || records()[i].titleOffset >= indexHeader->stringsSize)
+    {
+      printf("WARNING: Ignoring invalid photo index '%s'\n", path.c_str());
+      close();
+      return false;
+    }
+  return true;
+}
+
+void PhotoIndex::close()
+{
+  if (data)
+    munmap(data, length);
+  data = nullptr;
+  length = 0;
+}
+
+// Lists photos/videos of the account uploaded since minUploadDate (all when 0) into photos by id
+static bool listAccountPhotos(flickcurl* fc, int64_t minUploadDate, map<string,listedPhoto>* photos)
+{
+  auto minDate = minUploadDate ? to_string(minUploadDate) : string();
+  for (int page = 1;; ++page)
+  {
+    auto listed = limitedApiCall("flickr.people.getPhotos", [&] {
+      return flickcurl_people_getPhotos(fc, "me", 0, minUploadDate ? minDate.c_str() : nullptr, nullptr, nullptr,
+                                        nullptr, 0, 0, PHOTO_LIST_EXTRAS, PHOTO_INDEX_PAGE_SIZE, page); });
+    if (!listed)
+    {
+      printf("ERROR: Unable to list page %d of photos/videos in Flickr account\n", page);
+      return false;
+    }
+    int photosInPage{0};
+    for (; listed[photosInPage]; ++photosInPage)
+    {
+      auto photo = listed[photosInPage];
+      auto info = photoInfoFromListing(photo);
+      (*photos)[photo->id] = {info.title, hashValue(info.contentHash), photo->fields[PHOTO_FIELD_dateuploaded].integer};
+    }
+    flickcurl_free_photos(listed);
+    if (photosInPage < PHOTO_INDEX_PAGE_SIZE)
+      return true;
+  }
+}
+
+static bool saveIndex(const string& path, const map<string,listedPhoto>& photos, int64_t lastUploadDate)
+{
+  // Records are sorted by content hash, the oldest upload first
+  vector<const pair<const string,listedPhoto>*> sorted;
+  for (const auto& photo : photos)
+    sorted.push_back(&photo);
+  sort(sorted.begin(), sorted.end(), [](const pair<const string,listedPhoto>* a, const pair<const string,listedPhoto>* b)
+  {
+    if (a->second.contentHash != b->second.contentHash)
+      return a->second.contentHash < b->second.contentHash;
+    return a->second.uploadDate < b->second.uploadDate;
+  });
+
+  string strings;
+  vector<uint32_t> offsets;
+  for (auto photo : sorted)
+  {
+    offsets.push_back(strings.size());
+    strings.append(photo->first).push_back('\0');
+    offsets.push_back(strings.size());
+    strings.append(photo->second.title).push_back('\0');
+  }
+
+  auto tempPath = path + ".tmp";
+  auto file = fopen(tempPath.c_str(), "wb");
+  if (!file)
+    return false;
+  BinaryWriter writer(file);
+  for (auto c : PHOTO_INDEX_MAGIC)
+    writer.write(c);
+  writer.write(PHOTO_INDEX_VERSION);
+  writer.write(static_cast<uint32_t>(sorted.size()));
+  writer.write(static_cast<uint32_t>(strings.size()));
+  writer.write(lastUploadDate);
+  for (size_t i = 0; i < sorted.size(); ++i)
+  {
+    writer.write(sorted[i]->second.contentHash);
+    writer.write(sorted[i]->second.uploadDate);
+    writer.write(offsets[2 * i]);
+    writer.write(offsets[2 * i + 1]);
+  }
+  writer.ok = writer.ok && (strings.empty() || fwrite(strings.data(), strings.size(), 1, file) == 1);
+  if (fclose(file) == 0 && writer.ok)
+    return rename(tempPath.c_str(), path.c_str()) == 0;
+  remove(tempPath.c_str());
+  return false;
+}
+
+bool PhotoIndex::refresh(flickcurl* fc, bool full)
+{
+  auto path = photoIndexFile();
+  if (!full)
+    open(path);
+  auto lastUploadDate = data ? fileHeader()->lastUploadDate : 0;
+
+  map<string,listedPhoto> photos;
+  if (!listAccountPhotos(fc, lastUploadDate, &photos))
+    return data != nullptr;
+  printf("Photo index: %zu photos/videos uploaded to Flickr account since last refresh\n", photos.size());
+
+  // Upload date limit is inclusive, photos of the last refresh may be listed again
+  for (const auto& photo : photos)
+    lastUploadDate = max(lastUploadDate, photo.second.uploadDate);
+  for (size_t i = 0; i < size(); ++i)
+  {
+    const auto& indexed = records()[i];
+    if (!photos.count(strings() + indexed.idOffset))
+      photos[strings() + indexed.idOffset] = {strings() + indexed.titleOffset, indexed.contentHash, indexed.uploadDate};
+  }
+  if (data && photos.size() == size())
+    return true;
+
+  close();
+  if (!saveIndex(path, photos, lastUploadDate))
+    printf("WARNING: Unable to save photo index '%s'\n", path.c_str());
+  return open(path);
+}
+
+bool PhotoIndex::findContent(const string& contentHash, indexedPhoto* photo) const
+{
+  auto hash = hashValue(contentHash);
+  if (!hash || !data)
+    return false;
+  auto end = records() + fileHeader()->count;
+  auto found = lower_bound(records(), end, hash, [](const record& indexed, uint64_t value)
+  {
+    return indexed.contentHash < value;
+  });
+  if (found == end || found->contentHash != hash)
+    return false;
+  photo->id = strings() + found->idOffset;
+  photo->title = strings() + found->titleOffset;
+  return true;
+}
@@ -0,0 +1,58 @@
+/*
+ *
+ * flickrsync utility - Account-wide photo index for matching uploads across sets
+ *
+ */
+
+#ifndef PHOTOINDEX_H
+#define PHOTOINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include <flickcurl.h>
+
+extern const char* PHOTO_INDEX_FILE_NAME;
+
+struct indexedPhoto {
+  std::string id;
+  std::string title;
+};
+
+// Photos/videos of the whole Flickr account by content hash, stored in the home folder as fixed size
+// records sorted by content hash followed by their strings. The file is memory mapped and searched
+// in place, so a large account costs neither parsing nor heap memory. Refresh lists only the photos
+// uploaded since the last refresh; deleted photos stay in the index until a full refresh, so a reused
+// photo is still checked by adding it to the set.
+class PhotoIndex
+{
+public:
+  PhotoIndex() = default;
+  PhotoIndex(const PhotoIndex&) = delete;
+  PhotoIndex& operator=(const PhotoIndex&) = delete;
+  ~PhotoIndex();
+
+  // Lists photos uploaded since the last refresh, or all photos when full, and maps the updated
+  // index. When Flickr can not be listed the existing index is kept. Returns false without index.
+  bool refresh(flickcurl* fc, bool full);
+  // Oldest photo/video in account with content hash, returns false when there is none
+  bool findContent(const std::string& contentHash, indexedPhoto* photo) const;
+  size_t size() const;
+
+private:
+  struct header;
+  struct record;
+
+  bool open(const std::string& path);
+  void close();
+  const header* fileHeader() const;
+  const record* records() const;
+  const char* strings() const;
+
+  void* data{nullptr};
+  size_t length{0};
+};
+
+#endif // PHOTOINDEX_H
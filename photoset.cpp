@@ -0,0 +1,357 @@
+/*
+ *
+ * flickrsync utility - Photos of a Flickr photoset with title index
+ *
+ */
+
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "photoset.h"
+
+using namespace std;
+
+const uint64_t NON_NUMERIC_ID{1ULL << 63};
+const uint64_t ERASED_ID{~0ULL};
+const uint64_t PACKED_DATE{1ULL << 63};
+// Numeric ids are shorter, so they stay below NON_NUMERIC_ID
+const size_t MAX_NUMERIC_ID_LENGTH{18};
+
+namespace {
+
+// Date taken fields (YYYY-MM-DD HH:MM:SS) in packed date: offset in text, digits and bit position
+struct packedField {
+  size_t offset;
+  size_t length;
+  unsigned shift;
+};
+
+const packedField PACKED_FIELDS[] = {
+  {0, 4, 35}, {5, 2, 28}, {8, 2, 21}, {11, 2, 14}, {14, 2, 7}, {17, 2, 0}
+};
+
+const char* DATE_TAKEN_FORMAT{"dddd-dd-dd dd:dd:dd"};
+const size_t DATE_TAKEN_LENGTH{19};
+
+}
+
+static bool isDigit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+static void countUp(vector<uint32_t>* counts, uint32_t handle)
+{
+  if (handle >= counts->size())
+    counts->resize(handle + 1);
+  ++(*counts)[handle];
+}
+
+static bool counted(const vector<uint32_t>& counts, uint32_t handle)
+{
+  return handle < counts.size() && counts[handle];
+}
+
+PhotoSet::PhotoSet(PhotoSet&& other)
+{
+  *this = move(other);
+}
+
+PhotoSet& PhotoSet::operator=(PhotoSet&& other)
+{
+  if (this == &other)
+    return *this;
+  photos = move(other.photos);
+  photoCount = other.photoCount;
+  titles = move(other.titles);
+  contentHashes = move(other.contentHashes);
+  strings = move(other.strings);
+  photosById = move(other.photosById);
+  photosWithTitle = move(other.photosWithTitle);
+  unhashedPhotosWithTitle = move(other.unhashedPhotosWithTitle);
+  photosWithContentHash = move(other.photosWithContentHash);
+  reservedTitles = move(other.reservedTitles);
+  nextSuffix = move(other.nextSuffix);
+  nextPosition = other.nextPosition;
+
+  other.photos.clear();
+  other.photoCount = 0;
+  other.photosById.clear();
+  other.photosWithTitle.clear();
+  other.unhashedPhotosWithTitle.clear();
+  other.photosWithContentHash.clear();
+  other.reservedTitles.clear();
+  other.nextSuffix.clear();
+  other.nextPosition = 0;
+  return *this;
+}
+
+PhotoSet::const_iterator PhotoSet::find(const string& photoId) const
+{
+  auto index = findIndex(photoId);
+  return index == IndexTable::NOT_FOUND ? end() : const_iterator(this, index);
+}
+
+void PhotoSet::reserve(size_t count)
+{
+  photos.reserve(photos.size() + count);
+  photosById.reserve(photosById.size() + count, [this](uint32_t index) { return photos[index].id; });
+}
+
+void PhotoSet::add(const string& photoId, const photoInfo& info)
+{
+  auto photoIndex = findIndex(photoId);
+  if (photoIndex != IndexTable::NOT_FOUND)
+  {
+    unindex(photos[photoIndex]);
+    fill(&photos[photoIndex], info);
+  }
+  else
+  {
+    photoIndex = static_cast<uint32_t>(photos.size());
+    photoRecord photo;
+    photo.id = internId(photoId);
+    photo.listPosition = nextPosition++;
+    fill(&photo, info);
+    photos.push_back(photo);
+    photosById.insert(photo.id, photoIndex, [this](uint32_t index) { return photos[index].id; });
+    ++photoCount;
+  }
+  index(photos[photoIndex]);
+}
+
+PhotoSet::const_iterator PhotoSet::erase(const_iterator photo)
+{
+  auto& erased = photos[photo.index];
+  unindex(erased);
+  photosById.erase(erased.id, photo.index);
+  erased.id = ERASED_ID;
+  --photoCount;
+  return {this, nextPhoto(photo.index + 1)};
+}
+
+void PhotoSet::setTitle(const string& photoId, const string& title)
+{
+  auto index = findIndex(photoId);
+  if (index == IndexTable::NOT_FOUND)
+    return;
+  auto& photo = photos[index];
+  unindexTitle(photo);
+  photo.title = titles.intern(title);
+  countUp(&photosWithTitle, photo.title);
+  if (!photo.contentHash)
+    countUp(&unhashedPhotosWithTitle, photo.title);
+}
+
+vector<PhotoSet::const_iterator> PhotoSet::inListingOrder() const
+{
+  vector<const_iterator> listing;
+  listing.reserve(photoCount);
+  for (auto photo = begin(); photo != end(); ++photo)
+    listing.push_back(photo);
+  sort(listing.begin(), listing.end(), [this](const_iterator a, const_iterator b)
+  {
+    return photos[a.index].listPosition < photos[b.index].listPosition;
+  });
+  return listing;
+}
+
+void PhotoSet::setListingOrder(const vector<string>& photoIds)
+{
+  auto listing = inListingOrder();
+  vector<bool> listed(photos.size());
+  unsigned position{0};
+  for (const auto& photoId : photoIds)
+  {
+    auto index = findIndex(photoId);
+    if (index != IndexTable::NOT_FOUND && !listed[index])
+    {
+      photos[index].listPosition = position++;
+      listed[index] = true;
+    }
+  }
+  for (auto photo : listing)
+    if (!listed[photo.index])
+      photos[photo.index].listPosition = position++;
+  nextPosition = position;
+}
+
+PhotoSet::metadataKey PhotoSet::metadata(const_iterator photo) const
+{
+  const auto& record = photos[photo.index];
+  return {record.title, record.dateTaken, record.description};
+}
+
+bool PhotoSet::hasTitle(const string& title) const
+{
+  return counted(photosWithTitle, titles.find(title));
+}
+
+bool PhotoSet::hasContentHash(const string& contentHash) const
+{
+  return counted(photosWithContentHash, contentHashes.find(contentHash));
+}
+
+bool PhotoSet::hasPhoto(const string& title, const string& contentHash) const
+{
+  if (contentHash.empty())
+    return hasTitle(title);
+  return hasContentHash(contentHash) || counted(unhashedPhotosWithTitle, titles.find(title));
+}
+
+string PhotoSet::uniqueTitle(const string& title)
+{
+  if (!titleTaken(title))
+    return title;
+
+  // Suffixes below the remembered one were handed out before, so the search continues from there
+  auto& suffix = nextSuffix[titles.find(title)];
+  if (suffix < 1)
+    suffix = 1;
+  string correctedTitle = title + "-" + to_string(suffix);
+  while (titleTaken(correctedTitle))
+    correctedTitle = title + "-" + to_string(++suffix);
+  return correctedTitle;
+}
+
+void PhotoSet::reserveTitle(const string& title)
+{
+  countUp(&reservedTitles, titles.intern(title));
+}
+
+PhotoSet::photoEntry PhotoSet::entry(uint32_t index) const
+{
+  const auto& photo = photos[index];
+  photoEntry entry;
+  entry.first = idString(photo.id);
+  entry.second.title = titles.str(photo.title);
+  entry.second.dateTaken = dateString(photo.dateTaken);
+  entry.second.description = strings.str(photo.description);
+  entry.second.media = strings.str(photo.media);
+  entry.second.originalFormat = strings.str(photo.originalFormat);
+  entry.second.server = strings.str(photo.server);
+  entry.second.originalSecret = strings.str(photo.originalSecret);
+  entry.second.contentHash = contentHashes.str(photo.contentHash);
+  return entry;
+}
+
+uint32_t PhotoSet::nextPhoto(uint32_t index) const
+{
+  while (index < photos.size() && photos[index].id == ERASED_ID)
+    ++index;
+  return index;
+}
+
+uint32_t PhotoSet::findIndex(const string& photoId) const
+{
+  uint64_t id;
+  if (!encodeId(photoId, &id))
+    return IndexTable::NOT_FOUND;
+  return photosById.find(id, [this, id](uint32_t index) { return photos[index].id == id; });
+}
+
+// Encoded id of photoId, false when it is not numeric and not interned
+bool PhotoSet::encodeId(const string& photoId, uint64_t* id) const
+{
+  auto numeric = !photoId.empty() && photoId.size() <= MAX_NUMERIC_ID_LENGTH &&
+      (photoId[0] != '0' || photoId.size() == 1);
+  for (size_t i = 0; numeric && i < photoId.size(); ++i)
+    numeric = isDigit(photoId[i]);
+  if (numeric)
+  {
+    *id = stoull(photoId);
+    return true;
+  }
+  auto handle = strings.find(photoId);
+  *id = NON_NUMERIC_ID | handle;
+  return handle != StringArena::NOT_INTERNED;
+}
+
+uint64_t PhotoSet::internId(const string& photoId)
+{
+  uint64_t id;
+  if (!encodeId(photoId, &id))
+    id = NON_NUMERIC_ID | strings.intern(photoId);
+  return id;
+}
+
+string PhotoSet::idString(uint64_t id) const
+{
+  return id & NON_NUMERIC_ID ? strings.str(static_cast<uint32_t>(id)) : to_string(id);
+}
+
+uint64_t PhotoSet::internDate(const string& dateTaken)
+{
+  auto packable = dateTaken.size() == DATE_TAKEN_LENGTH;
+  for (size_t i = 0; packable && i < DATE_TAKEN_LENGTH; ++i)
+    packable = DATE_TAKEN_FORMAT[i] == 'd' ? isDigit(dateTaken[i]) : dateTaken[i] == DATE_TAKEN_FORMAT[i];
+  if (!packable)
+    return strings.intern(dateTaken);
+
+  auto date = PACKED_DATE;
+  for (const auto& field : PACKED_FIELDS)
+  {
+    uint64_t value{0};
+    for (size_t i = 0; i < field.length; ++i)
+      value = value * 10 + (dateTaken[field.offset + i] - '0');
+    date |= value << field.shift;
+  }
+  return date;
+}
+
+string PhotoSet::dateString(uint64_t dateTaken) const
+{
+  if (!(dateTaken & PACKED_DATE))
+    return strings.str(static_cast<uint32_t>(dateTaken));
+
+  // Fields are 7 bits wide except the year
+  unsigned values[6];
+  for (size_t i = 0; i < 6; ++i)
+    values[i] = (dateTaken >> PACKED_FIELDS[i].shift) & (i ? 0x7f : 0x3fff);
+  char text[DATE_TAKEN_LENGTH + 1];
+  snprintf(text, sizeof(text), "%04u-%02u-%02u %02u:%02u:%02u", values[0], values[1], values[2], values[3], values[4],
+           values[5]);
+  return text;
+}
+
+void PhotoSet::fill(photoRecord* photo, const photoInfo& info)
+{
+  photo->dateTaken = internDate(info.dateTaken);
+  photo->title = titles.intern(info.title);
+  photo->contentHash = contentHashes.intern(info.contentHash);
+  photo->description = strings.intern(info.description);
+  photo->media = strings.intern(info.media);
+  photo->originalFormat = strings.intern(info.originalFormat);
+  photo->server = strings.intern(info.server);
+  photo->originalSecret = strings.intern(info.originalSecret);
+}
+
+void PhotoSet::index(const photoRecord& photo)
+{
+  countUp(&photosWithTitle, photo.title);
+  if (photo.contentHash)
+    countUp(&photosWithContentHash, photo.contentHash);
+  else
+    countUp(&unhashedPhotosWithTitle, photo.title);
+}
+
+void PhotoSet::unindex(const photoRecord& photo)
+{
+  unindexTitle(photo);
+  if (photo.contentHash)
+    --photosWithContentHash[photo.contentHash];
+}
+
+void PhotoSet::unindexTitle(const photoRecord& photo)
+{
+  --photosWithTitle[photo.title];
+  if (!photo.contentHash)
+    --unhashedPhotosWithTitle[photo.title];
+}
+
+bool PhotoSet::titleTaken(const string& title) const
+{
+  auto handle = titles.find(title);
+  return counted(photosWithTitle, handle) || counted(reservedTitles, handle);
+}
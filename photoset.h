@@ -0,0 +1,166 @@
+/*
+ *
+ * flickrsync utility - Photos of a Flickr photoset with title index
+ *
+ */
+
+#ifndef PHOTOSET_H
+#define PHOTOSET_H
+
+#include <stdint.h>
+
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "flickrsync.h"
+#include "indextable.h"
+#include "stringarena.h"
+
+// Photo id => info of the set contents, indexed by photo id, title and content hash so that lookups and
+// suffix selection for duplicate titles do not need to scan the whole set. Photos are kept compact for sets
+// of a million photos: one flat record each with numeric photo id, packed date taken and handles of interned
+// strings, in order of adding. Iterating materializes id and photoInfo of each photo, so loops over large sets
+// should dereference an iterator once. Iterators stay valid when photos are added or erased, but not when
+// the set is moved. All modifications must go through add/erase/setTitle to keep the indexes consistent.
+// The order of the set listing is kept too, photos added later come last.
+class PhotoSet
+{
+public:
+  typedef std::pair<std::string,photoInfo> photoEntry;
+
+  class const_iterator
+  {
+  public:
+    struct arrowProxy {
+      photoEntry entry;
+      const photoEntry* operator->() const { return &entry; }
+    };
+
+    typedef std::forward_iterator_tag iterator_category;
+    typedef photoEntry value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef arrowProxy pointer;
+    typedef photoEntry reference;
+
+    const_iterator() = default;
+
+    photoEntry operator*() const { return set->entry(index); }
+    arrowProxy operator->() const { return {set->entry(index)}; }
+    const_iterator& operator++() { index = set->nextPhoto(index + 1); return *this; }
+    const_iterator operator++(int) { auto previous = *this; ++*this; return previous; }
+    bool operator==(const const_iterator& other) const { return index == other.index && set == other.set; }
+    bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+  private:
+    friend class PhotoSet;
+    const_iterator(const PhotoSet* set, uint32_t index) : set(set), index(index) {}
+
+    const PhotoSet* set{nullptr};
+    uint32_t index{0};
+  };
+
+  // Title, date taken and description of a photo as interned values, equal when the strings are equal
+  struct metadataKey {
+    uint32_t title;
+    uint64_t dateTaken;
+    uint32_t description;
+
+    bool operator==(const metadataKey& other) const
+    {
+      return title == other.title && dateTaken == other.dateTaken && description == other.description;
+    }
+  };
+
+  PhotoSet() = default;
+  PhotoSet(const PhotoSet&) = delete;
+  PhotoSet& operator=(const PhotoSet&) = delete;
+  // Moved from set is left empty
+  PhotoSet(PhotoSet&& other);
+  PhotoSet& operator=(PhotoSet&& other);
+
+  const_iterator begin() const { return {this, nextPhoto(0)}; }
+  const_iterator end() const { return {this, static_cast<uint32_t>(photos.size())}; }
+  const_iterator find(const std::string& photoId) const;
+  size_t size() const { return photoCount; }
+  bool empty() const { return !photoCount; }
+  // Makes room for count more photos
+  void reserve(size_t count);
+
+  void add(const std::string& photoId, const photoInfo& info);
+  const_iterator erase(const_iterator photo);
+  void setTitle(const std::string& photoId, const std::string& title);
+  // Photos/videos in the order of the set listing
+  std::vector<const_iterator> inListingOrder() const;
+  // Records the set order after reordering, photos not in photoIds keep their order after them
+  void setListingOrder(const std::vector<std::string>& photoIds);
+
+  std::string photoId(const_iterator photo) const { return idString(photos[photo.index].id); }
+  metadataKey metadata(const_iterator photo) const;
+
+  bool hasTitle(const std::string& title) const;
+  bool hasContentHash(const std::string& contentHash) const;
+  // With content hash, photo/video exists when a photo/video with the same content exists,
+  // or one with the same title that was uploaded without content hash
+  bool hasPhoto(const std::string& title, const std::string& contentHash) const;
+  // Returns title, or title-n when title is already existing in set or reserved. n is the first free one
+  // starting from the n returned for title last time, so suffixes freed below it are not reused.
+  std::string uniqueTitle(const std::string& title);
+  // Keeps title taken for uniqueTitle without a photo/video in set, such as the title of a planned upload
+  void reserveTitle(const std::string& title);
+  // Releases all titles kept by reserveTitle
+  void releaseTitles() { reservedTitles.clear(); }
+
+private:
+  struct photoRecord {
+    // Numeric photo id, NON_NUMERIC_ID with handle in strings for others, ERASED_ID for erased photos
+    uint64_t id;
+    // PACKED_DATE with date fields, or handle in strings for dates not in Flickr format
+    uint64_t dateTaken;
+    uint32_t title;           // in titles
+    uint32_t contentHash;     // in contentHashes
+    // Handles in strings
+    uint32_t description;
+    uint32_t media;
+    uint32_t originalFormat;
+    uint32_t server;
+    uint32_t originalSecret;
+    uint32_t listPosition;
+  };
+
+  photoEntry entry(uint32_t index) const;
+  uint32_t nextPhoto(uint32_t index) const;
+  uint32_t findIndex(const std::string& photoId) const;
+  bool encodeId(const std::string& photoId, uint64_t* id) const;
+  uint64_t internId(const std::string& photoId);
+  std::string idString(uint64_t id) const;
+  uint64_t internDate(const std::string& dateTaken);
+  std::string dateString(uint64_t dateTaken) const;
+  void fill(photoRecord* photo, const photoInfo& info);
+  void index(const photoRecord& photo);
+  void unindex(const photoRecord& photo);
+  void unindexTitle(const photoRecord& photo);
+  bool titleTaken(const std::string& title) const;
+
+  std::vector<photoRecord> photos;
+  size_t photoCount{0};
+  StringArena titles;
+  StringArena contentHashes;
+  StringArena strings;
+  // Photo id => index in photos
+  IndexTable photosById;
+  // Title handle => number of photos with the title, and of those without content hash
+  std::vector<uint32_t> photosWithTitle;
+  std::vector<uint32_t> unhashedPhotosWithTitle;
+  // Content hash handle => number of photos with the content hash
+  std::vector<uint32_t> photosWithContentHash;
+  // Title handle => number of reservations of the title
+  std::vector<uint32_t> reservedTitles;
+  // Title handle => suffix to try first, only for titles that needed one
+  std::unordered_map<uint32_t,int> nextSuffix;
+  unsigned nextPosition{0};
+};
+
+#endif // PHOTOSET_H
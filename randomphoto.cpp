@@ -0,0 +1,172 @@
+/*
+ *
+ * flickrsync utility - Random photo sampling for --get-random-photo
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include <random>
+#include <vector>
+
+#include "ratelimiter.h"
+#include "randomphoto.h"
+
+using namespace std;
+
+const char* SET_LIST_CACHE_FILE_NAME{".flickrsync.sets"};
+const time_t SET_LIST_CACHE_TTL{60 * 60}; // seconds
+
+namespace {
+
+struct cachedSet {
+  string id;
+  string title;
+  int photoCount;
+};
+
+}
+
+static string setListCacheFile()
+{
+  auto home = getenv("HOME");
+  if (home)
+    return string(home) + '/' + SET_LIST_CACHE_FILE_NAME;
+  return SET_LIST_CACHE_FILE_NAME;
+}
+
+// Cache file has line "id<TAB>photo count<TAB>title" per set
+static bool loadSetList(vector<cachedSet>* sets)
+{
+  auto path = setListCacheFile();
+  struct stat status;
+  if (stat(path.c_str(), &status) || time(nullptr) - status.st_mtime > SET_LIST_CACHE_TTL)
+    return false;
+
+  auto file = fopen(path.c_str(), "r");
+  if (!file)
+    return false;
+  char* line = nullptr;
+  size_t lineSize = 0;
+  ssize_t length;
+  while ((length = getline(&line, &lineSize, file)) > 0)
+  {
+    string entry(line, length);
+    if (entry.back() == '\n')
+      entry.pop_back();
+    auto countStart = entry.find('\t');
+    auto titleStart = countStart == string::npos ? string::npos : entry.find('\t', countStart + 1);
+    if (titleStart != string::npos)
+      sets->push_back({entry.substr(0, countStart), entry.substr(titleStart + 1),
+                       atoi(entry.c_str() + countStart + 1)});
+  }
+  free(line);
+  fclose(file);
+  return !sets->empty();
+}
+
+static void saveSetList(const vector<cachedSet>& sets)
+{
+  auto path = setListCacheFile();
+  auto tempPath = path + ".tmp";
+  auto file = fopen(tempPath.c_str(), "w");
+  if (!file)
+    return;
+  auto ok = true;
+  for (const auto& set : sets)
+    ok = fprintf(file, "%s\t%d\t%s\n", set.id.c_str(), set.photoCount, set.title.c_str()) > 0 && ok;
+  if (fclose(file) == 0 && ok)
+    rename(tempPath.c_str(), path.c_str());
+  else
+    remove(tempPath.c_str());
+}
+
+static bool fetchSetList(flickcurl* fc, vector<cachedSet>* sets)
+{
+  auto photosets = limitedApiCall("flickr.photosets.getList", [&] { return flickcurl_photosets_getList(fc, nullptr); });
+  if (!photosets)
+    return false;
+  for (int i = 0; photosets[i]; ++i)
+    sets->push_back({photosets[i]->id, photosets[i]->title, photosets[i]->photos_count});
+  flickcurl_free_photosets(photosets);
+  saveSetList(*sets);
+  return true;
+}
+
+// Lists one photo at offset in set, totalCount receives the number of photos/videos in set
+static bool fetchPhotoAt(flickcurl* fc, const string& setId, int offset, randomPhoto* photo, int* totalCount)
+{
+  flickcurl_photos_list_params params;
+  flickcurl_photos_list_params_init(&params);
+  params.extras = PHOTO_LIST_EXTRAS;
+  params.per_page = 1;
+  params.page = offset + 1;
+  auto list = limitedApiCall("flickr.photosets.getPhotos", [&] {
+    return flickcurl_photosets_getPhotos_params(fc, setId.c_str(), -1, &params); });
+  if (!list)
+    return false;
+
+  *totalCount = list->total_count;
+  auto found = list->photos_count > 0;
+  if (found)
+  {
+    photo->photoId = list->photos[0]->id;
+    photo->info = photoInfoFromListing(list->photos[0]);
+  }
+  flickcurl_free_photos_list(list);
+  return found;
+}
+
+bool pickRandomPhoto(flickcurl* fc, const string& setName, randomPhoto* photo)
+{
+  static default_random_engine engine{random_device{}()};
+
+  vector<cachedSet> sets;
+  auto cached = loadSetList(&sets);
+  if (!cached && !fetchSetList(fc, &sets))
+    return false;
+
+  for (;;)
+  {
+    // Named set is picked even without photo count, it may have only videos (not counted in photo count)
+    vector<cachedSet*> candidates;
+    vector<double> weights;
+    for (auto& set : sets)
+      if (setName.empty() ? set.photoCount > 0 : set.title == setName)
+      {
+        candidates.push_back(&set);
+        weights.push_back(max(1, set.photoCount));
+      }
+
+    if (!candidates.empty())
+    {
+      auto set = candidates[discrete_distribution<size_t>(weights.begin(), weights.end())(engine)];
+      photo->setTitle = set->title;
+
+      int totalCount{0};
+      auto count = max(1, set->photoCount);
+      if (fetchPhotoAt(fc, set->id, uniform_int_distribution<int>(0, count - 1)(engine), photo, &totalCount) &&
+          totalCount == set->photoCount)
+        return true;
+      // Photo count of set list does not count videos, the cache gets the total count for next picks
+      if (totalCount > 0)
+      {
+        set->photoCount = totalCount;
+        saveSetList(sets);
+        if (fetchPhotoAt(fc, set->id, uniform_int_distribution<int>(0, totalCount - 1)(engine), photo, &totalCount))
+          return true;
+      }
+    }
+
+    // Sets may have changed since the set list was cached
+    if (!cached)
+      return false;
+    cached = false;
+    sets.clear();
+    if (!fetchSetList(fc, &sets))
+      return false;
+  }
+}
@@ -0,0 +1,25 @@
+/*
+ *
+ * flickrsync utility - Random photo sampling for --get-random-photo
+ *
+ */
+
+#ifndef RANDOMPHOTO_H
+#define RANDOMPHOTO_H
+
+#include <string>
+
+#include "flickrsync.h"
+
+struct randomPhoto {
+  std::string setTitle;
+  std::string photoId;
+  photoInfo info;
+};
+
+// Picks random photo/video from the set titled setName, or from a set chosen at random weighted by
+// the set photo counts when setName is empty. The set list is cached locally for an hour, so a pick
+// normally costs a single listing call of one photo. Returns false when there is no photo to pick.
+bool pickRandomPhoto(flickcurl* fc, const std::string& setName, randomPhoto* photo);
+
+#endif // RANDOMPHOTO_H
@@ -0,0 +1,123 @@
+/*
+ *
+ * flickrsync utility - Rate limiting and concurrency control of Flickr API calls
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+
+#include "ratelimiter.h"
+
+using namespace std;
+
+ApiRateLimiter apiRateLimiter;
+
+const unsigned MAX_CALLS_IN_FLIGHT{16};
+const double BURST_FRACTION{0.1};         // part of the hourly budget that can be used at once
+const double SLOW_CALL_FACTOR{4};         // call slower than this times usual latency counts as congestion
+const double USUAL_LATENCY_WEIGHT{1.0 / 32};
+const unsigned RETRY_DELAY_MS{1000};      // doubled for each attempt
+
+// Flickr error codes of temporary failures, other errors returned by Flickr fail the same way when retried
+const int SERVICE_UNAVAILABLE_ERROR{105};
+const int WRITE_FAILED_ERROR{106};
+// flickcurl reports errors returned by Flickr as "Method <name> failed with error <code> - <message>"
+const char FLICKR_ERROR_TEXT[]{" failed with error "};
+
+static thread_local string lastApiError;
+
+void recordApiError(const char* message)
+{
+  lastApiError = message ? message : "";
+}
+
+ApiCallOutcome apiCallOutcome(int error)
+{
+  if (!error)
+    return API_CALL_OK;
+  // Transport and HTTP errors, like rate limiting and server errors, are reported in other forms
+  auto found = lastApiError.find(FLICKR_ERROR_TEXT);
+  if (found == string::npos)
+    return API_CALL_FAILED;
+  auto code = atoi(lastApiError.c_str() + found + strlen(FLICKR_ERROR_TEXT));
+  return code == SERVICE_UNAVAILABLE_ERROR || code == WRITE_FAILED_ERROR ? API_CALL_FAILED : API_CALL_REJECTED;
+}
+
+ApiRateLimiter::ApiRateLimiter()
+  : refilled(chrono::steady_clock::now()), limit(MAX_CALLS_IN_FLIGHT)
+{
+  setBudget(DEFAULT_API_BUDGET);
+}
+
+void ApiRateLimiter::setBudget(unsigned callsPerHour)
+{
+  lock_guard<std::mutex> lock(mutex);
+  capacity = max(1.0, callsPerHour * BURST_FRACTION);
+  tokens = capacity;
+  tokensPerSecond = callsPerHour / 3600.0;
+}
+
+void ApiRateLimiter::refill(chrono::steady_clock::time_point now)
+{
+  chrono::duration<double> elapsed = now - refilled;
+  tokens = min(capacity, tokens + elapsed.count() * tokensPerSecond);
+  refilled = now;
+}
+
+void ApiRateLimiter::acquire()
+{
+  unique_lock<std::mutex> lock(mutex);
+  for (;;)
+  {
+    if (inFlight >= static_cast<unsigned>(limit))
+    {
+      released.wait(lock);
+      continue;
+    }
+    refill(chrono::steady_clock::now());
+    if (tokens >= 1)
+      break;
+    // Woken up earlier if a call completes, the limit may have grown
+    auto wait = chrono::duration<double>((1 - tokens) / tokensPerSecond);
+    released.wait_for(lock, chrono::duration_cast<chrono::milliseconds>(wait) + chrono::milliseconds(1));
+  }
+  tokens -= 1;
+  ++inFlight;
+}
+
+void ApiRateLimiter::release(const char* endpoint, double seconds, ApiCallOutcome outcome)
+{
+  {
+    lock_guard<std::mutex> lock(mutex);
+    --inFlight;
+
+    auto slow = false;
+    if (endpoint && outcome == API_CALL_OK)
+    {
+      auto usual = usualLatency.find(endpoint);
+      slow = usual != usualLatency.end() && seconds > SLOW_CALL_FACTOR * usual->second;
+      if (usual == usualLatency.end())
+        usualLatency[endpoint] = seconds;
+      else
+        usual->second += (seconds - usual->second) * USUAL_LATENCY_WEIGHT;
+    }
+
+    if (outcome == API_CALL_FAILED || slow)
+      limit = max(1.0, limit / 2);
+    else if (outcome == API_CALL_OK)
+      limit = min(static_cast<double>(MAX_CALLS_IN_FLIGHT), limit + 1 / limit);
+  }
+  released.notify_all();
+}
+
+chrono::milliseconds ApiRateLimiter::retryDelay(int attempt) const
+{
+  static thread_local default_random_engine engine{random_device{}()};
+  auto delay = RETRY_DELAY_MS << (attempt - 1);
+  uniform_int_distribution<unsigned> jitter(delay / 2, delay);
+  return chrono::milliseconds(jitter(engine));
+}
@@ -0,0 +1,93 @@
+/*
+ *
+ * flickrsync utility - Rate limiting and concurrency control of Flickr API calls
+ *
+ */
+
+#ifndef RATELIMITER_H
+#define RATELIMITER_H
+
+#include <stdio.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "stats.h"
+
+// Hourly call budget of Flickr API key
+const unsigned DEFAULT_API_BUDGET{3600};
+
+// Outcome of API call: failed calls (transport, server or rate limit errors) are worth retrying, rejected calls
+// (e.g. photo not found) are answered by Flickr and fail the same way again
+enum ApiCallOutcome { API_CALL_OK, API_CALL_REJECTED, API_CALL_FAILED };
+
+// Records the last flickcurl error message of the calling thread, nullptr clears it
+void recordApiError(const char* message);
+// Outcome of the call that returned error code, based on the error message recorded for the calling thread
+ApiCallOutcome apiCallOutcome(int error);
+
+// Token bucket for the hourly call budget, and AIMD limit for calls in flight: the limit is increased by one
+// per limit successful calls and halved after failed calls or calls much slower than usual for the endpoint.
+// Rejected calls do not change the limit.
+class ApiRateLimiter
+{
+public:
+  ApiRateLimiter();
+
+  void setBudget(unsigned callsPerHour);
+
+  // Waits for a token and a free slot for call in flight
+  void acquire();
+  // Endpoint is nullptr for calls whose latency depends on the data sent (uploads), they are not checked for slowness
+  void release(const char* endpoint, double seconds, ApiCallOutcome outcome);
+
+  // Jittered exponential backoff before retry attempt
+  std::chrono::milliseconds retryDelay(int attempt) const;
+
+private:
+  void refill(std::chrono::steady_clock::time_point now);
+
+  std::mutex mutex;
+  std::condition_variable released;
+  double capacity;
+  double tokens;
+  double tokensPerSecond;
+  std::chrono::steady_clock::time_point refilled;
+  unsigned inFlight{0};
+  double limit;
+  std::map<std::string,double> usualLatency;
+};
+
+extern ApiRateLimiter apiRateLimiter;
+
+const int API_CALL_ATTEMPTS{4};
+
+// Calls flickcurl function within the rate limits, retrying failed calls when retry is set
+// (not for calls that are not idempotent, like upload or photoset creation). Rejected calls are not retried.
+template <typename Call>
+auto limitedApiCall(const char* endpoint, Call call, bool retry = true) -> decltype(call())
+{
+  for (int attempt = 1; ; ++attempt)
+  {
+    apiRateLimiter.acquire();
+    recordApiError(nullptr);
+    auto start = std::chrono::steady_clock::now();
+    auto result = timedApiCall(endpoint, call);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    auto error = apiErrorCode(result);
+    auto outcome = apiCallOutcome(error);
+    apiRateLimiter.release(endpoint, elapsed.count(), outcome);
+    if (outcome != API_CALL_FAILED || !retry || attempt == API_CALL_ATTEMPTS)
+      return result;
+
+    auto delay = apiRateLimiter.retryDelay(attempt);
+    printf("WARNING: Flickr API call %s failed (%d), retrying in %.1f seconds\n", endpoint, error, delay.count() / 1000.0);
+    std::this_thread::sleep_for(delay);
+  }
+}
+
+#endif // RATELIMITER_H
@@ -0,0 +1,53 @@
+/*
+ *
+ * flickrsync utility - Concurrent photo title changes
+ *
+ */
+
+#include <stdio.h>
+
+#include <chrono>
+#include <mutex>
+
+#include "ratelimiter.h"
+#include "renamer.h"
+
+using namespace std;
+
+const size_t PROGRESS_INTERVAL{100}; // photos between progress reports
+
+vector<titleChange> applyTitleChanges(flickcurl* fc, const vector<titleChange>& changes, unsigned jobs)
+{
+  vector<titleChange> failed;
+  if (changes.empty())
+    return failed;
+
+  auto start = chrono::steady_clock::now();
+  size_t applied{0};
+  mutex resultsMutex;
+  forEachConcurrently(fc, changes.size(), jobs, [&](flickcurl* session, size_t i)
+  {
+    const auto& change = changes[i];
+    auto ret = limitedApiCall("flickr.photos.setMeta", [&] {
+      return flickcurl_photos_setMeta(session, change.photoId.c_str(), change.newTitle.c_str(),
+                                      change.description.c_str()); });
+
+    lock_guard<mutex> lock(resultsMutex);
+    if (ret)
+    {
+      printf("ERROR: Unable to set photo %s title to %s: %d\n", change.oldTitle.c_str(), change.newTitle.c_str(), ret);
+      failed.push_back(change);
+    }
+    else if (++applied % PROGRESS_INTERVAL == 0)
+    {
+      chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+      printf("Set titles of %zu/%zu photos/videos (%.1f per second)\n", applied, changes.size(),
+             applied / elapsed.count());
+    }
+  });
+
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  printf("Set titles of %zu photos/videos based on date taken in %.1f seconds (%.1f per second), %zu failed\n",
+         applied, elapsed.count(), applied / elapsed.count(), failed.size());
+  return failed;
+}
@@ -0,0 +1,27 @@
+/*
+ *
+ * flickrsync utility - Concurrent photo title changes
+ *
+ */
+
+#ifndef RENAMER_H
+#define RENAMER_H
+
+#include <string>
+#include <vector>
+
+#include "flickrsync.h"
+
+struct titleChange {
+  std::string photoId;
+  std::string oldTitle;
+  std::string newTitle;
+  // Current description, setMeta replaces the title and the description together
+  std::string description;
+};
+
+// Sets photo titles with up to jobs sessions concurrently, printing progress and throughput.
+// Returns the changes that could not be applied.
+std::vector<titleChange> applyTitleChanges(flickcurl* fc, const std::vector<titleChange>& changes, unsigned jobs);
+
+#endif // RENAMER_H
@@ -0,0 +1,59 @@
+/*
+ *
+ * flickrsync utility - Fast folder scanner
+ *
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "scanner.h"
+
+using namespace std;
+
+const size_t SCAN_BUFFER_SIZE{256 * 1024};
+
+namespace {
+
+struct linuxDirent64 {
+  ino64_t d_ino;
+  off64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+}
+
+static bool isRegularFile(int folderFd, const char* fileName)
+{
+  struct statx status;
+  return statx(folderFd, fileName, AT_NO_AUTOMOUNT, STATX_TYPE, &status) == 0 && S_ISREG(status.stx_mode);
+}
+
+bool scanFolder(const string& folderPath, const function<void(const char* fileName)>& found)
+{
+  auto folderFd = open(folderPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (folderFd < 0)
+    return false;
+
+  string buffer(SCAN_BUFFER_SIZE, '\0');
+  long length;
+  while ((length = syscall(SYS_getdents64, folderFd, &buffer[0], buffer.size())) > 0)
+    for (long position = 0; position < length; )
+    {
+      auto entry = reinterpret_cast<const linuxDirent64*>(&buffer[position]);
+      position += entry->d_reclen;
+      if (entry->d_name[0] == '.')
+        continue;
+      if (entry->d_type == DT_REG ||
+          ((entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) && isRegularFile(folderFd, entry->d_name)))
+        found(entry->d_name);
+    }
+
+  close(folderFd);
+  return length == 0;
+}
@@ -0,0 +1,18 @@
+/*
+ *
+ * flickrsync utility - Fast folder scanner
+ *
+ */
+
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <functional>
+#include <string>
+
+// Lists regular files (and symlinks to regular files) of folder in directory order with getdents64.
+// Hidden files are skipped. File type comes from the directory entry, statx is used only when the
+// entry type is unknown or a symlink. Returns false when the folder can not be read.
+bool scanFolder(const std::string& folderPath, const std::function<void(const char* fileName)>& found);
+
+#endif // SCANNER_H
@@ -0,0 +1,94 @@
+/*
+ *
+ * flickrsync utility - Photoset listing with concurrent page fetching
+ *
+ */
+
+#include <stdio.h>
+
+#include <utility>
+#include <vector>
+
+#include "setlisting.h"
+#include "ratelimiter.h"
+
+using namespace std;
+
+const int LISTING_PAGE_SIZE{500};
+
+namespace {
+
+struct listingPage {
+  vector<pair<string,photoInfo>> photos;
+  int totalCount{0};
+  bool fetched{false};
+};
+
+}
+
+static bool fetchPage(flickcurl* fc, const string& setId, int page, listingPage* result)
+{
+  flickcurl_photos_list_params params;
+  flickcurl_photos_list_params_init(&params);
+  params.extras = PHOTO_LIST_EXTRAS;
+  params.per_page = LISTING_PAGE_SIZE;
+  params.page = page;
+  if (auto list = limitedApiCall("flickr.photosets.getPhotos", [&] {
+        return flickcurl_photosets_getPhotos_params(fc, setId.c_str(), -1, &params); }))
+  {
+    for (int i = 0; i < list->photos_count; ++i)
+      result->photos.emplace_back(list->photos[i]->id, photoInfoFromListing(list->photos[i]));
+    result->totalCount = list->total_count;
+    result->fetched = true;
+    flickcurl_free_photos_list(list);
+    return true;
+  }
+  printf("ERROR: Unable to list page %d of photoset '%s'\n", page, setId.c_str());
+  return false;
+}
+
+static bool isFullPage(const listingPage& page)
+{
+  return page.photos.size() >= static_cast<size_t>(LISTING_PAGE_SIZE);
+}
+
+bool listSetPhotos(flickcurl* fc, const string& setId, int photoCountHint, unsigned jobs, PhotoSet* photos)
+{
+  vector<listingPage> pages(1);
+  if (!fetchPage(fc, setId, 1, &pages[0]))
+    return false;
+
+  auto exactCount = pages[0].totalCount > 0;
+  auto photoCount = exactCount ? pages[0].totalCount : photoCountHint;
+  auto pageCount = isFullPage(pages[0]) ? max(1, (photoCount + LISTING_PAGE_SIZE - 1) / LISTING_PAGE_SIZE) : 1;
+  pages.resize(pageCount);
+
+  if (pageCount > 1)
+  {
+    forEachConcurrently(fc, pageCount - 1, jobs, [&](flickcurl* session, size_t i)
+    {
+      fetchPage(session, setId, i + 2, &pages[i + 1]);
+    });
+
+    for (const auto& page : pages)
+      if (!page.fetched)
+        return false;
+  }
+
+  // Without total count the hint may be too small (e.g. videos are not counted), continue until a partial page
+  while (!exactCount && isFullPage(pages.back()))
+  {
+    pages.emplace_back();
+    if (!fetchPage(fc, setId, pages.size(), &pages.back()))
+      return false;
+  }
+
+  size_t listed{0};
+  for (const auto& page : pages)
+    listed += page.photos.size();
+  photos->reserve(listed);
+  for (const auto& page : pages)
+    for (const auto& photo : page.photos)
+      photos->add(photo.first, photo.second);
+  return true;
+}
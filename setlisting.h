@@ -0,0 +1,23 @@
+/*
+ *
+ * flickrsync utility - Photoset listing with concurrent page fetching
+ *
+ */
+
+#ifndef SETLISTING_H
+#define SETLISTING_H
+
+#include <string>
+
+#include "photoset.h"
+
+// Photos listed per call
+extern const int LISTING_PAGE_SIZE;
+
+// Lists all photos of photoset. The first page tells the total photo count, the remaining
+// pages are then fetched concurrently with up to jobs sessions and merged in page order.
+// photoCountHint (photo count from photoset list) is used when the total is not returned.
+// Returns false when a page could not be fetched, photos is then incomplete.
+bool listSetPhotos(flickcurl* fc, const std::string& setId, int photoCountHint, unsigned jobs, PhotoSet* photos);
+
+#endif // SETLISTING_H
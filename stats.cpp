@@ -0,0 +1,118 @@
+/*
+ *
+ * flickrsync utility - API call and sync phase statistics
+ *
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "stats.h"
+
+using namespace std;
+
+SyncStats syncStats;
+
+// Latency histogram buckets grow by 2^(1/4) from 0.1ms, the last bucket covers everything over ~100s
+const int HISTOGRAM_BUCKETS{81};
+const double HISTOGRAM_FIRST_BUCKET{0.0001};
+
+static int histogramBucket(double seconds)
+{
+  if (seconds <= HISTOGRAM_FIRST_BUCKET)
+    return 0;
+  return min(HISTOGRAM_BUCKETS - 1, static_cast<int>(ceil(4 * log2(seconds / HISTOGRAM_FIRST_BUCKET))));
+}
+
+static double histogramBucketLimit(int bucket)
+{
+  return HISTOGRAM_FIRST_BUCKET * exp2(bucket / 4.0);
+}
+
+static double percentile(const vector<uint64_t>& histogram, uint64_t calls, double maxSeconds, double fraction)
+{
+  auto rank = static_cast<uint64_t>(ceil(fraction * calls));
+  uint64_t count{0};
+  for (size_t bucket = 0; bucket < histogram.size(); ++bucket)
+  {
+    count += histogram[bucket];
+    if (count >= rank)
+      return min(maxSeconds, histogramBucketLimit(bucket));
+  }
+  return maxSeconds;
+}
+
+void SyncStats::recordCall(const string& endpoint, double seconds, int errorCode, uint64_t bytes)
+{
+  lock_guard<std::mutex> lock(mutex);
+  auto& stats = endpoints[endpoint];
+  if (stats.histogram.empty())
+    stats.histogram.resize(HISTOGRAM_BUCKETS);
+  ++stats.calls;
+  stats.bytes += bytes;
+  stats.seconds += seconds;
+  stats.maxSeconds = max(stats.maxSeconds, seconds);
+  ++stats.histogram[histogramBucket(seconds)];
+  if (errorCode)
+    ++stats.errors[errorCode];
+}
+
+void SyncStats::startPhase(const char* phase)
+{
+  lock_guard<std::mutex> lock(mutex);
+  auto& stats = phases[phase];
+  ++stats.count;
+  if (!stats.active++)
+    stats.activeSince = chrono::steady_clock::now();
+}
+
+void SyncStats::endPhase(const char* phase)
+{
+  lock_guard<std::mutex> lock(mutex);
+  auto& stats = phases[phase];
+  if (stats.active && !--stats.active)
+    stats.seconds += chrono::duration<double>(chrono::steady_clock::now() - stats.activeSince).count();
+}
+
+bool SyncStats::writeJson(const string& path) const
+{
+  auto file = fopen(path.c_str(), "w");
+  if (!file)
+    return false;
+
+  lock_guard<std::mutex> lock(mutex);
+  fprintf(file, "{\n  \"phases\": {");
+  const char* separator = "";
+  for (const auto& phase : phases)
+  {
+    fprintf(file, "%s\n    \"%s\": {\"count\": %llu, \"seconds\": %.6f}", separator, phase.first.c_str(),
+            static_cast<unsigned long long>(phase.second.count), phase.second.seconds);
+    separator = ",";
+  }
+  fprintf(file, "\n  },\n  \"endpoints\": {");
+  separator = "";
+  for (const auto& endpoint : endpoints)
+  {
+    const auto& stats = endpoint.second;
+    fprintf(file, "%s\n    \"%s\": {\"calls\": %llu, \"bytes\": %llu, \"seconds\": %.6f, "
+                  "\"p50\": %.6f, \"p95\": %.6f, \"p99\": %.6f, \"max\": %.6f, \"errors\": {",
+            separator, endpoint.first.c_str(), static_cast<unsigned long long>(stats.calls),
+            static_cast<unsigned long long>(stats.bytes), stats.seconds,
+            percentile(stats.histogram, stats.calls, stats.maxSeconds, 0.50),
+            percentile(stats.histogram, stats.calls, stats.maxSeconds, 0.95),
+            percentile(stats.histogram, stats.calls, stats.maxSeconds, 0.99),
+            stats.maxSeconds);
+    const char* errorSeparator = "";
+    for (const auto& error : stats.errors)
+    {
+      fprintf(file, "%s\"%d\": %llu", errorSeparator, error.first, static_cast<unsigned long long>(error.second));
+      errorSeparator = ", ";
+    }
+    fprintf(file, "}}");
+    separator = ",";
+  }
+  fprintf(file, "\n  }\n}\n");
+  return fclose(file) == 0;
+}
@@ -0,0 +1,107 @@
+/*
+ *
+ * flickrsync utility - API call and sync phase statistics
+ *
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Call counts, latency histograms, transferred bytes and error codes per API endpoint,
+// and wall times per sync phase. Recording is thread safe. With folders synced concurrently
+// the wall time of a phase is the time in which at least one folder was in it.
+class SyncStats
+{
+public:
+  void recordCall(const std::string& endpoint, double seconds, int errorCode, uint64_t bytes);
+  void startPhase(const char* phase);
+  void endPhase(const char* phase);
+  bool writeJson(const std::string& path) const;
+
+private:
+  struct endpointStats {
+    uint64_t calls{0};
+    uint64_t bytes{0};
+    double seconds{0};
+    double maxSeconds{0};
+    std::vector<uint64_t> histogram;
+    std::map<int,uint64_t> errors;
+  };
+
+  struct phaseStats {
+    uint64_t count{0};
+    double seconds{0};
+    // Folders in the phase, and since when there are any
+    unsigned active{0};
+    std::chrono::steady_clock::time_point activeSince;
+  };
+
+  mutable std::mutex mutex;
+  std::map<std::string,endpointStats> endpoints;
+  std::map<std::string,phaseStats> phases;
+};
+
+extern SyncStats syncStats;
+
+// Times one API call, the call is recorded when done() is called
+class ApiCallTimer
+{
+public:
+  explicit ApiCallTimer(const char* endpoint)
+    : endpoint(endpoint), start(std::chrono::steady_clock::now()) {}
+
+  void done(int errorCode = 0, uint64_t bytes = 0)
+  {
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    syncStats.recordCall(endpoint, elapsed.count(), errorCode, bytes);
+  }
+
+private:
+  const char* endpoint;
+  std::chrono::steady_clock::time_point start;
+};
+
+// Times sync phases of one folder, the current phase ends when the next one starts or the timer is destroyed
+class PhaseTimer
+{
+public:
+  explicit PhaseTimer(const char* phase)
+    : phase(phase) { syncStats.startPhase(phase); }
+  ~PhaseTimer() { next(nullptr); }
+
+  void next(const char* nextPhase)
+  {
+    if (phase)
+      syncStats.endPhase(phase);
+    phase = nextPhase;
+    if (phase)
+      syncStats.startPhase(phase);
+  }
+
+private:
+  const char* phase;
+};
+
+inline int apiErrorCode(int result) { return result; }
+template <typename T>
+inline int apiErrorCode(T* result) { return result ? 0 : -1; }
+
+// Calls flickcurl function, recording its latency and result (non-zero return code, or -1 for NULL result)
+template <typename Call>
+auto timedApiCall(const char* endpoint, Call call) -> decltype(call())
+{
+  ApiCallTimer timer(endpoint);
+  auto result = call();
+  timer.done(apiErrorCode(result));
+  return result;
+}
+
+#endif // STATS_H
@@ -0,0 +1,88 @@
+/*
+ *
+ * flickrsync utility - Interned strings stored back to back in one buffer
+ *
+ */
+
+#include <string.h>
+
+#include "stringarena.h"
+
+using namespace std;
+
+// FNV-1a
+static uint64_t hashBytes(const char* data, size_t length)
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < length; ++i)
+  {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+StringArena::StringArena()
+  : offsets{0, 0}
+{
+}
+
+StringArena::StringArena(StringArena&& other)
+  : StringArena()
+{
+  *this = move(other);
+}
+
+StringArena& StringArena::operator=(StringArena&& other)
+{
+  if (this == &other)
+    return *this;
+  chars.swap(other.chars);
+  offsets.swap(other.offsets);
+  swap(table, other.table);
+  other.chars.clear();
+  other.offsets.assign(2, 0);
+  other.table.clear();
+  return *this;
+}
+
+uint32_t StringArena::intern(const string& value)
+{
+  if (value.empty())
+    return 0;
+  auto hash = hashBytes(value.data(), value.size());
+  auto handle = table.find(hash, [&](uint32_t handle)
+  {
+    return length(handle) == value.size() && memcmp(data(handle), value.data(), value.size()) == 0;
+  });
+  if (handle != IndexTable::NOT_FOUND)
+    return handle;
+
+  handle = static_cast<uint32_t>(size());
+  chars.insert(chars.end(), value.begin(), value.end());
+  offsets.push_back(static_cast<uint32_t>(chars.size()));
+  table.insert(hash, handle, [this](uint32_t handle) { return hashOf(handle); });
+  return handle;
+}
+
+uint32_t StringArena::find(const string& value) const
+{
+  if (value.empty())
+    return 0;
+  return table.find(hashBytes(value.data(), value.size()), [&](uint32_t handle)
+  {
+    return length(handle) == value.size() && memcmp(data(handle), value.data(), value.size()) == 0;
+  });
+}
+
+void StringArena::reserve(size_t count, size_t bytes)
+{
+  chars.reserve(chars.size() + bytes);
+  offsets.reserve(offsets.size() + count);
+  table.reserve(table.size() + count, [this](uint32_t handle) { return hashOf(handle); });
+}
+
+uint64_t StringArena::hashOf(uint32_t handle) const
+{
+  return hashBytes(data(handle), length(handle));
+}
@@ -0,0 +1,51 @@
+/*
+ *
+ * flickrsync utility - Interned strings stored back to back in one buffer
+ *
+ */
+
+#ifndef STRINGARENA_H
+#define STRINGARENA_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "indextable.h"
+
+// Stores each distinct string once and refers to it by a dense 32-bit handle, so that equal strings
+// have equal handles. Handle 0 is the empty string. Strings are never removed, the arena only grows.
+class StringArena
+{
+public:
+  static const uint32_t NOT_INTERNED{IndexTable::NOT_FOUND};
+
+  StringArena();
+  // Moved from arena is left empty
+  StringArena(StringArena&& other);
+  StringArena& operator=(StringArena&& other);
+
+  // Handle of value, adding it when not stored yet
+  uint32_t intern(const std::string& value);
+  // Handle of value, NOT_INTERNED when not stored
+  uint32_t find(const std::string& value) const;
+
+  std::string str(uint32_t handle) const { return handle ? std::string(data(handle), length(handle)) : std::string(); }
+  const char* data(uint32_t handle) const { return chars.data() + offsets[handle]; }
+  size_t length(uint32_t handle) const { return offsets[handle + 1] - offsets[handle]; }
+
+  // Number of distinct strings, handles are below it
+  size_t size() const { return offsets.size() - 1; }
+  void reserve(size_t count, size_t bytes);
+
+private:
+  uint64_t hashOf(uint32_t handle) const;
+
+  std::vector<char> chars;
+  // Start of each string in chars, followed by the end of the last one
+  std::vector<uint32_t> offsets;
+  IndexTable table;
+};
+
+#endif // STRINGARENA_H
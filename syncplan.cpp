@@ -0,0 +1,162 @@
+/*
+ *
+ * flickrsync utility - Sync plans recorded by dry run and applied later
+ *
+ */
+
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "binaryfile.h"
+#include "syncplan.h"
+
+using namespace std;
+
+const char PLAN_MAGIC[4]{'F', 'S', 'P', 'L'};
+const uint32_t PLAN_VERSION{1};
+const uint32_t PLAN_END_MARKER{0x454e4421};
+
+bool savePlans(const string& path, const vector<syncPlan>& plans)
+{
+  auto tempPath = path + ".tmp";
+  auto file = fopen(tempPath.c_str(), "wb");
+  if (!file)
+    return false;
+
+  BinaryWriter writer(file);
+  writer.ok = fwrite(PLAN_MAGIC, sizeof(PLAN_MAGIC), 1, file) == 1;
+  writer.write(PLAN_VERSION);
+  writer.write(static_cast<uint32_t>(plans.size()));
+  for (const auto& plan : plans)
+  {
+    writer.write(plan.folderPath);
+    writer.write(plan.setName);
+    writer.write(plan.setId);
+    writer.write(static_cast<int32_t>(plan.setPhotoCount));
+
+    writer.write(static_cast<uint32_t>(plan.renames.size()));
+    for (const auto& rename : plan.renames)
+    {
+      writer.write(rename.photoId);
+      writer.write(rename.oldTitle);
+      writer.write(rename.newTitle);
+      writer.write(rename.description);
+    }
+    writer.write(static_cast<uint32_t>(plan.uploads.size()));
+    for (const auto& upload : plan.uploads)
+    {
+      writer.write(upload.title);
+      writer.write(upload.filePath);
+      writer.write(upload.contentHash);
+    }
+    writer.write(static_cast<uint32_t>(plan.deletes.size()));
+    for (const auto& photo : plan.deletes)
+    {
+      writer.write(photo.photoId);
+      writer.write(photo.title);
+    }
+    writer.write(static_cast<uint32_t>(plan.downloads.size()));
+    for (const auto& download : plan.downloads)
+    {
+      writer.write(download.photoId);
+      writer.write(download.info);
+    }
+    writer.write(static_cast<uint8_t>(plan.reorder));
+    writer.write(static_cast<uint32_t>(plan.reorderedPhotos.size()));
+    for (const auto& photo : plan.reorderedPhotos)
+    {
+      writer.write(photo.first);
+      writer.write(photo.second);
+    }
+  }
+  writer.write(PLAN_END_MARKER);
+
+  auto saved = fclose(file) == 0 && writer.ok && rename(tempPath.c_str(), path.c_str()) == 0;
+  if (!saved)
+    remove(tempPath.c_str());
+  return saved;
+}
+
+bool loadPlans(const string& path, vector<syncPlan>* plans)
+{
+  auto file = fopen(path.c_str(), "rb");
+  if (!file)
+    return false;
+
+  BinaryReader reader(file);
+  char magic[sizeof(PLAN_MAGIC)];
+  auto valid = fread(magic, sizeof(magic), 1, file) == 1 &&
+      equal(magic, magic + sizeof(magic), PLAN_MAGIC) &&
+      reader.read<uint32_t>() == PLAN_VERSION;
+  if (valid)
+  {
+    // Counts are checked against the bytes left in the file, so a corrupted file does not make huge allocations
+    auto planCount = reader.read<uint32_t>();
+    // Folder path, set name, set id, set photo count, four counts, reorder flag and the reorder count
+    reader.fits(planCount, 3 * STRING_MIN_BYTES + 5 * sizeof(uint32_t) + sizeof(uint8_t) + sizeof(int32_t));
+    for (uint32_t i = 0; i < planCount && reader.ok; ++i)
+    {
+      syncPlan plan;
+      plan.folderPath = reader.readString();
+      plan.setName = reader.readString();
+      plan.setId = reader.readString();
+      plan.setPhotoCount = reader.read<int32_t>();
+
+      auto count = reader.read<uint32_t>();
+      reader.fits(count, 4 * STRING_MIN_BYTES);
+      for (uint32_t j = 0; j < count && reader.ok; ++j)
+      {
+        titleChange rename;
+        rename.photoId = reader.readString();
+        rename.oldTitle = reader.readString();
+        rename.newTitle = reader.readString();
+        rename.description = reader.readString();
+        plan.renames.push_back(move(rename));
+      }
+      count = reader.read<uint32_t>();
+      reader.fits(count, 3 * STRING_MIN_BYTES);
+      for (uint32_t j = 0; j < count && reader.ok; ++j)
+      {
+        plannedUpload upload;
+        upload.title = reader.readString();
+        upload.filePath = reader.readString();
+        upload.contentHash = reader.readString();
+        plan.uploads.push_back(move(upload));
+      }
+      count = reader.read<uint32_t>();
+      reader.fits(count, 2 * STRING_MIN_BYTES);
+      for (uint32_t j = 0; j < count && reader.ok; ++j)
+      {
+        plannedDelete photo;
+        photo.photoId = reader.readString();
+        photo.title = reader.readString();
+        plan.deletes.push_back(move(photo));
+      }
+      count = reader.read<uint32_t>();
+      reader.fits(count, STRING_MIN_BYTES + PHOTO_INFO_MIN_BYTES);
+      for (uint32_t j = 0; j < count && reader.ok; ++j)
+      {
+        plannedDownload download;
+        download.photoId = reader.readString();
+        download.info = reader.readPhotoInfo();
+        plan.downloads.push_back(move(download));
+      }
+      plan.reorder = reader.read<uint8_t>() != 0;
+      count = reader.read<uint32_t>();
+      reader.fits(count, 2 * STRING_MIN_BYTES);
+      for (uint32_t j = 0; j < count && reader.ok; ++j)
+      {
+        auto photoId = reader.readString();
+        plan.reorderedPhotos.emplace_back(photoId, reader.readString());
+      }
+      plans->push_back(move(plan));
+    }
+    valid = reader.read<uint32_t>() == PLAN_END_MARKER && reader.ok;
+  }
+  fclose(file);
+
+  if (!valid)
+    plans->clear();
+  return valid;
+}
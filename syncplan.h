@@ -0,0 +1,52 @@
+/*
+ *
+ * flickrsync utility - Sync plans recorded by dry run and applied later
+ *
+ */
+
+#ifndef SYNCPLAN_H
+#define SYNCPLAN_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "flickrsync.h"
+#include "renamer.h"
+
+struct plannedUpload {
+  std::string title;
+  std::string filePath;
+  std::string contentHash;
+};
+
+struct plannedDelete {
+  std::string photoId;
+  std::string title;
+};
+
+struct plannedDownload {
+  std::string photoId;
+  photoInfo info;
+};
+
+// Changes planned for one folder and its photoset. The photoset is created by the first upload
+// when setId is empty. reorderedPhotos (photo id, title) lists the photos staying in the set
+// in set order, with planned titles, when the set is to be reordered by title after the uploads.
+struct syncPlan {
+  std::string folderPath;
+  std::string setName;
+  std::string setId;
+  int setPhotoCount{-1};
+  std::vector<titleChange> renames;
+  std::vector<plannedUpload> uploads;
+  std::vector<plannedDelete> deletes;
+  std::vector<plannedDownload> downloads;
+  bool reorder{false};
+  std::vector<std::pair<std::string,std::string>> reorderedPhotos;
+};
+
+bool savePlans(const std::string& path, const std::vector<syncPlan>& plans);
+bool loadPlans(const std::string& path, std::vector<syncPlan>* plans);
+
+#endif // SYNCPLAN_H
@@ -0,0 +1,88 @@
+/*
+ *
+ * flickrsync utility - Natural title order and minimal photoset reordering for --sort-by-title
+ *
+ */
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "titleorder.h"
+
+using namespace std;
+
+static bool isDigit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+bool naturalTitleLess(const string& a, const string& b)
+{
+  size_t i = 0;
+  size_t j = 0;
+  while (i < a.size() && j < b.size())
+  {
+    if (!isDigit(a[i]) || !isDigit(b[j]))
+    {
+      if (a[i] != b[j])
+        return static_cast<unsigned char>(a[i]) < static_cast<unsigned char>(b[j]);
+      ++i;
+      ++j;
+      continue;
+    }
+
+    // Numbers of the same value compare equal whatever their length, leading zeros are skipped
+    auto startA = i;
+    auto startB = j;
+    while (i < a.size() && a[i] == '0')
+      ++i;
+    while (j < b.size() && b[j] == '0')
+      ++j;
+    auto valueA = i;
+    auto valueB = j;
+    while (i < a.size() && isDigit(a[i]))
+      ++i;
+    while (j < b.size() && isDigit(b[j]))
+      ++j;
+    if (i - valueA != j - valueB)
+      return i - valueA < j - valueB;
+    if (auto result = a.compare(valueA, i - valueA, b, valueB, j - valueB))
+      return result < 0;
+    if (i - startA != j - startB)
+      return i - startA < j - startB;
+  }
+  return a.size() - i < b.size() - j;
+}
+
+vector<string> sortedByTitle(const vector<pair<string,string>>& photos)
+{
+  vector<const pair<string,string>*> sorted;
+  sorted.reserve(photos.size());
+  for (const auto& photo : photos)
+    sorted.push_back(&photo);
+  stable_sort(sorted.begin(), sorted.end(), [](const pair<string,string>* a, const pair<string,string>* b)
+  {
+    return naturalTitleLess(a->second, b->second);
+  });
+
+  vector<string> ids;
+  ids.reserve(sorted.size());
+  for (auto photo : sorted)
+    ids.push_back(photo->first);
+  return ids;
+}
+
+size_t reorderedPrefixLength(const vector<pair<string,string>>& photos, const vector<string>& sortedIds)
+{
+  unordered_map<string,size_t> positions;
+  positions.reserve(photos.size());
+  for (size_t i = 0; i < photos.size(); ++i)
+    positions[photos[i].first] = i;
+
+  // The longest tail of the sorted order that is in the same order in the set can stay in place
+  auto prefixLength = sortedIds.size();
+  while (prefixLength > 0 && (prefixLength == sortedIds.size() ||
+                              positions[sortedIds[prefixLength - 1]] < positions[sortedIds[prefixLength]]))
+    --prefixLength;
+  return prefixLength;
+}
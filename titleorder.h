@@ -0,0 +1,30 @@
+/*
+ *
+ * flickrsync utility - Natural title order and minimal photoset reordering for --sort-by-title
+ *
+ */
+
+#ifndef TITLEORDER_H
+#define TITLEORDER_H
+
+#include <stddef.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// Compares titles in natural order: runs of digits compare by their value, so that
+// title-2 sorts before title-10 and title before title-1
+bool naturalTitleLess(const std::string& a, const std::string& b);
+
+// Ids of photos (id, title pairs in set order) sorted naturally by title. The sort is stable,
+// photos with equal titles keep their order in the set.
+std::vector<std::string> sortedByTitle(const std::vector<std::pair<std::string,std::string>>& photos);
+
+// Number of photos at the start of sortedIds that need to be moved to the front of the set to
+// get the set into sorted order, 0 when the set is already sorted. The photos after them are
+// already in sorted order in the set.
+size_t reorderedPrefixLength(const std::vector<std::pair<std::string,std::string>>& photos,
+                             const std::vector<std::string>& sortedIds);
+
+#endif // TITLEORDER_H
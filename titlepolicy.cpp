@@ -0,0 +1,136 @@
+/*
+ *
+ * flickrsync utility - Date based photo title policy
+ *
+ */
+
+#include "titlepolicy.h"
+
+using namespace std;
+
+const char* DEFAULT_TITLE_TEMPLATE{"%Y%m%d-%H%M%S"};
+
+TitlePolicy titlePolicy;
+
+namespace {
+
+struct dateField {
+  char field;
+  size_t offset;  // in date taken (YYYY-MM-DD HH:MM:SS)
+  size_t length;
+};
+
+const dateField DATE_FIELDS[] = {
+  {'Y', 0, 4}, {'m', 5, 2}, {'d', 8, 2}, {'H', 11, 2}, {'M', 14, 2}, {'S', 17, 2}
+};
+
+const char* DATE_TAKEN_FORMAT{"dddd-dd-dd dd:dd:dd"};
+const size_t DATE_TAKEN_LENGTH{19};
+
+}
+
+static const dateField* findDateField(char field)
+{
+  for (const auto& dateField : DATE_FIELDS)
+    if (dateField.field == field)
+      return &dateField;
+  return nullptr;
+}
+
+static bool isDigit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+static bool isDateTaken(const string& dateTaken)
+{
+  if (dateTaken.size() < DATE_TAKEN_LENGTH)
+    return false;
+  for (size_t i = 0; i < DATE_TAKEN_LENGTH; ++i)
+    if (DATE_TAKEN_FORMAT[i] == 'd' ? !isDigit(dateTaken[i]) : dateTaken[i] != DATE_TAKEN_FORMAT[i])
+      return false;
+  return true;
+}
+
+TitlePolicy::TitlePolicy(const string& titleTemplate)
+{
+  for (size_t i = 0; i < titleTemplate.size(); ++i)
+  {
+    auto c = titleTemplate[i];
+    if (c == '%' && i + 1 < titleTemplate.size() && titleTemplate[i + 1] != '%')
+    {
+      auto field = titleTemplate[++i];
+      if (!findDateField(field))
+        isValid = false;
+      segments.push_back({field, ""});
+      continue;
+    }
+    if (c == '%')
+    {
+      if (i + 1 == titleTemplate.size())
+        isValid = false;
+      ++i;
+    }
+    if (segments.empty() || segments.back().field)
+      segments.push_back({0, ""});
+    segments.back().literal += c;
+  }
+}
+
+bool TitlePolicy::matches(const string& title) const
+{
+  size_t position = 0;
+  for (const auto& segment : segments)
+  {
+    if (segment.field)
+    {
+      auto dateField = findDateField(segment.field);
+      if (!dateField || title.size() - position < dateField->length)
+        return false;
+      for (size_t i = 0; i < dateField->length; ++i)
+        if (!isDigit(title[position++]))
+          return false;
+    }
+    else
+    {
+      if (title.compare(position, segment.literal.size(), segment.literal) != 0)
+        return false;
+      position += segment.literal.size();
+    }
+  }
+
+  // Optional -n suffix
+  if (position == title.size())
+    return true;
+  if (title[position++] != '-')
+    return false;
+  for (; position < title.size(); ++position)
+    if (!isDigit(title[position]))
+      return false;
+  return true;
+}
+
+bool TitlePolicy::titleFor(const string& dateTaken, string* title) const
+{
+  title->clear();
+  if (!isValid || !isDateTaken(dateTaken))
+    return false;
+  for (const auto& segment : segments)
+  {
+    if (segment.field)
+    {
+      auto dateField = findDateField(segment.field);
+      title->append(dateTaken, dateField->offset, dateField->length);
+    }
+    else
+      title->append(segment.literal);
+  }
+  return true;
+}
+
+string TitlePolicy::titleFor(const string& dateTaken) const
+{
+  string title;
+  titleFor(dateTaken, &title);
+  return title;
+}
@@ -0,0 +1,46 @@
+/*
+ *
+ * flickrsync utility - Date based photo title policy
+ *
+ */
+
+#ifndef TITLEPOLICY_H
+#define TITLEPOLICY_H
+
+#include <string>
+#include <vector>
+
+// Template of date based titles: %Y (year), %m (month), %d (day), %H (hour), %M (minute), %S (second),
+// %% (percent sign), other characters are copied as is
+extern const char* DEFAULT_TITLE_TEMPLATE;
+
+// Date based titles made by template. The template is parsed once, matching titles and making
+// titles from date taken do not allocate memory (beyond the capacity of the reused title string).
+class TitlePolicy
+{
+public:
+  explicit TitlePolicy(const std::string& titleTemplate = DEFAULT_TITLE_TEMPLATE);
+
+  // False if the template has unknown % fields
+  bool valid() const { return isValid; }
+
+  // True if title is made by the template, with optional -n suffix added for photos taken at the same second
+  bool matches(const std::string& title) const;
+
+  // Makes title from date taken in Flickr format (YYYY-MM-DD HH:MM:SS), false if date taken is not in that format
+  bool titleFor(const std::string& dateTaken, std::string* title) const;
+  std::string titleFor(const std::string& dateTaken) const;
+
+private:
+  struct segment {
+    char field;           // 0 for literal text
+    std::string literal;
+  };
+
+  std::vector<segment> segments;
+  bool isValid{true};
+};
+
+extern TitlePolicy titlePolicy;
+
+#endif // TITLEPOLICY_H
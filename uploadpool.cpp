@@ -0,0 +1,116 @@
+/*
+ *
+ * flickrsync utility - Concurrent upload pipeline
+ *
+ */
+
+#include <stdio.h>
+
+#include "uploadpool.h"
+
+using namespace std;
+
+UploadPool::UploadPool(unsigned jobs, const string& setName, string* setId)
+  : setName(setName), setId(setId), ownsSessions(true)
+{
+  if (!jobs)
+    return;
+
+  // One session for the set stage and one for each uploader
+  for (unsigned i = 0; i < jobs + 1; ++i)
+    if (auto session = newFlickcurlSession())
+      sessions.emplace_back(session);
+  start();
+}
+
+UploadPool::UploadPool(const vector<flickcurl*>& sessions, const string& setName, string* setId)
+  : setName(setName), setId(setId), sessions(sessions), ownsSessions(false)
+{
+  if (!sessions.empty())
+    start();
+}
+
+void UploadPool::start()
+{
+  if (sessions.size() < 2)
+  {
+    printf("ERROR: Unable to create Flickr sessions for uploading\n");
+    if (ownsSessions)
+      for (auto session : sessions)
+        flickcurl_free(session);
+    sessions.clear();
+    return;
+  }
+
+  // The set stage is a single thread, so set creation is serialized and only one set gets created
+  setStage = thread(&UploadPool::setWorker, this, sessions[0]);
+  for (size_t i = 1; i < sessions.size(); ++i)
+    uploaders.emplace_back(&UploadPool::uploadWorker, this, sessions[i]);
+}
+
+UploadPool::~UploadPool()
+{
+  finish();
+}
+
+void UploadPool::upload(const string& title, const string& filePath, const string& contentHash)
+{
+  if (sessions.empty())
+  {
+    printf("Uploading photo/video %s ...Failed!\n", filePath.c_str());
+    return;
+  }
+  uploadQueue.push({title, filePath, contentHash});
+}
+
+void UploadPool::finish()
+{
+  if (finished)
+    return;
+  finished = true;
+
+  uploadQueue.close();
+  for (auto& uploader : uploaders)
+    uploader.join();
+  setQueue.close();
+  if (setStage.joinable())
+    setStage.join();
+
+  if (ownsSessions)
+    for (auto session : sessions)
+      flickcurl_free(session);
+  sessions.clear();
+}
+
+void UploadPool::uploadWorker(flickcurl* session)
+{
+  uploadJob job;
+  while (uploadQueue.pop(&job))
+  {
+    auto photoId = uploadPhoto(session, job.title, job.filePath, job.contentHash);
+    if (!photoId.empty())
+    {
+      printf("Uploading photo/video %s ...Done (id=%s)\n", job.filePath.c_str(), photoId.c_str());
+      {
+        lock_guard<mutex> lock(resultsMutex);
+        uploaded[job.title] = photoId;
+      }
+      setQueue.push({job.title, photoId, job.contentHash});
+    }
+    else
+      printf("Uploading photo/video %s ...Failed!\n", job.filePath.c_str());
+  }
+}
+
+void UploadPool::setWorker(flickcurl* session)
+{
+  uploadedPhoto photo;
+  while (setQueue.pop(&photo))
+    if (addToSet(session, photo.photoId, setName, setId))
+    {
+      lock_guard<mutex> lock(resultsMutex);
+      auto& info = addedToSet[photo.photoId];
+      info.title = photo.title;
+      info.contentHash = photo.contentHash;
+    }
+}
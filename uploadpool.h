@@ -0,0 +1,73 @@
+/*
+ *
+ * flickrsync utility - Concurrent upload pipeline
+ *
+ */
+
+#ifndef UPLOADPOOL_H
+#define UPLOADPOOL_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "flickrsync.h"
+#include "workqueue.h"
+
+// Uploads files with a pool of workers, each using its own flickcurl session.
+// Uploaded photos are handed over to a single set stage that adds them to the
+// photoset (creating it on first add) while the next uploads are in progress.
+class UploadPool
+{
+public:
+  UploadPool(unsigned jobs, const std::string& setName, std::string* setId);
+  // Uses sessions of the caller, the first for the set stage and the others for uploading. Sessions are not freed,
+  // so a long running caller can reuse them for many pools.
+  UploadPool(const std::vector<flickcurl*>& sessions, const std::string& setName, std::string* setId);
+  ~UploadPool();
+
+  void upload(const std::string& title, const std::string& filePath, const std::string& contentHash);
+  // Waits until all queued files are uploaded and added to the set
+  void finish();
+
+  // Title => photo id of all successfully uploaded photos/videos
+  const std::map<std::string,std::string>& uploadedPhotos() const { return uploaded; }
+  // Photo id => info of uploaded photos/videos successfully added to the set
+  const std::map<std::string,photoInfo>& photosAddedToSet() const { return addedToSet; }
+
+private:
+  struct uploadJob {
+    std::string title;
+    std::string filePath;
+    std::string contentHash;
+  };
+
+  struct uploadedPhoto {
+    std::string title;
+    std::string photoId;
+    std::string contentHash;
+  };
+
+  void start();
+  void uploadWorker(flickcurl* session);
+  void setWorker(flickcurl* session);
+
+  const std::string setName;
+  std::string* setId;
+
+  WorkQueue<uploadJob> uploadQueue;
+  WorkQueue<uploadedPhoto> setQueue;
+  std::vector<flickcurl*> sessions;
+  bool ownsSessions;
+  std::vector<std::thread> uploaders;
+  std::thread setStage;
+  bool finished{false};
+
+  std::mutex resultsMutex;
+  std::map<std::string,std::string> uploaded;
+  std::map<std::string,photoInfo> addedToSet;
+};
+
+#endif // UPLOADPOOL_H
@@ -0,0 +1,185 @@
+/*
+ *
+ * flickrsync utility - Watch mode uploading new files as they appear in folders
+ *
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <map>
+
+#include "contenthash.h"
+#include "downloader.h"
+#include "uploadpool.h"
+#include "watcher.h"
+
+using namespace std;
+
+// Time a file has to stay untouched after it was written before it is uploaded
+const chrono::seconds WATCH_QUIET_PERIOD{5};
+// Longest wait for inotify events, so a signal arriving just before poll is noticed
+const int WATCH_SIGNAL_CHECK_MS{1000};
+
+static volatile sig_atomic_t stopWatching{0};
+
+static void stopWatchingHandler(int)
+{
+  stopWatching = 1;
+}
+
+namespace {
+
+struct pendingFile {
+  size_t folder;
+  string fileName;
+  chrono::steady_clock::time_point lastChange;
+};
+
+}
+
+static bool isWatchedFileName(const char* name)
+{
+  auto length = strlen(name);
+  auto suffixLength = PARTIAL_DOWNLOAD_SUFFIX.size();
+  return length && name[0] != '.' &&
+      !(length > suffixLength && PARTIAL_DOWNLOAD_SUFFIX.compare(name + length - suffixLength) == 0);
+}
+
+static void uploadFiles(watchedFolder& folder, const vector<string>& fileNames, const vector<flickcurl*>& sessions,
+                        bool matchContent)
+{
+  vector<localFile> files;
+  for (const auto& fileName : fileNames)
+    files.push_back({fileName, 0, 0, 0, ""});
+  if (matchContent)
+    hashFiles(folder.path, &files, {});
+
+  size_t uploaded{0};
+  {
+    UploadPool uploadPool(sessions, folder.setName, &folder.setId);
+    for (const auto& file : files)
+    {
+      auto filePath = folder.path + '/' + file.fileName;
+      auto title = titleFromFileName(file.fileName);
+      if (folder.photosInSet.hasPhoto(title, file.contentHash) || folder.dryRunUploads.count(title))
+        printf("Photo/video %s is already existing in set, skipping\n", title.c_str());
+      else if (!dryRun)
+        uploadPool.upload(title, filePath, file.contentHash);
+      else
+      {
+        printf("Need to upload photo %s\n", filePath.c_str());
+        folder.dryRunUploads.insert(title);
+        ++uploaded;
+      }
+    }
+
+    uploadPool.finish();
+    uploaded += uploadPool.uploadedPhotos().size();
+    for (const auto& added : uploadPool.photosAddedToSet())
+      folder.photosInSet.add(added.first, added.second);
+  }
+  printf("FlickrSync watch: Uploaded=%ld, Photos/videos in Flickr set '%s'=%ld\n", uploaded, folder.setName.c_str(),
+         folder.photosInSet.size());
+}
+
+void watchFolders(vector<watchedFolder>& folders, unsigned jobs, bool matchContent)
+{
+  auto fd = inotify_init1(IN_CLOEXEC);
+  if (fd < 0)
+  {
+    printf("ERROR: Unable to watch folders: %s\n", strerror(errno));
+    return;
+  }
+
+  map<int,size_t> watches;
+  for (size_t i = 0; i < folders.size(); ++i)
+  {
+    auto wd = inotify_add_watch(fd, folders[i].path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY);
+    if (wd < 0)
+      printf("ERROR: Unable to watch folder '%s': %s\n", folders[i].path.c_str(), strerror(errno));
+    else
+      watches[wd] = i;
+  }
+  printf("Watching %ld folders for new photos/videos...\n", watches.size());
+
+  // Upload sessions are kept for the whole watch, one for the set stage and one for each uploader
+  vector<flickcurl*> sessions;
+  for (unsigned i = 0; !dryRun && i < jobs + 1; ++i)
+    if (auto session = newFlickcurlSession())
+      sessions.emplace_back(session);
+
+  // Handlers are reset by the first signal, so a second one terminates
+  struct sigaction stopAction, oldInterruptAction, oldTerminateAction;
+  memset(&stopAction, 0, sizeof(stopAction));
+  stopAction.sa_handler = stopWatchingHandler;
+  stopAction.sa_flags = SA_RESETHAND;
+  sigemptyset(&stopAction.sa_mask);
+  stopWatching = 0;
+  sigaction(SIGINT, &stopAction, &oldInterruptAction);
+  sigaction(SIGTERM, &stopAction, &oldTerminateAction);
+
+  map<string,pendingFile> pending;
+  alignas(inotify_event) char buffer[64 * (sizeof(inotify_event) + NAME_MAX + 1)];
+  while (!watches.empty() && !stopWatching)
+  {
+    auto now = chrono::steady_clock::now();
+    auto timeout = WATCH_SIGNAL_CHECK_MS;
+    for (const auto& file : pending)
+    {
+      auto remaining = chrono::duration_cast<chrono::milliseconds>(file.second.lastChange + WATCH_QUIET_PERIOD - now);
+      timeout = min(timeout, static_cast<int>(max<long long>(0, remaining.count())));
+    }
+
+    pollfd pollFd{fd, POLLIN, 0};
+    if (poll(&pollFd, 1, timeout) > 0)
+    {
+      auto length = read(fd, buffer, sizeof(buffer));
+      for (auto position = buffer; length > 0 && position < buffer + length; )
+      {
+        auto event = reinterpret_cast<const inotify_event*>(position);
+        position += sizeof(inotify_event) + event->len;
+        if (!event->len || (event->mask & IN_ISDIR) || !isWatchedFileName(event->name))
+          continue;
+        auto folder = watches.find(event->wd);
+        if (folder == watches.end())
+          continue;
+
+        // Files are queued once closed after writing, further modifications restart the quiet period
+        auto key = folders[folder->second].path + '/' + event->name;
+        if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+          pending[key] = {folder->second, event->name, chrono::steady_clock::now()};
+        else if (pending.count(key))
+          pending[key].lastChange = chrono::steady_clock::now();
+      }
+    }
+
+    now = chrono::steady_clock::now();
+    map<size_t,vector<string>> quietFiles;
+    for (auto file = pending.begin(); file != pending.end(); )
+      if (now - file->second.lastChange >= WATCH_QUIET_PERIOD)
+      {
+        quietFiles[file->second.folder].push_back(file->second.fileName);
+        file = pending.erase(file);
+      }
+      else
+        ++file;
+    for (const auto& files : quietFiles)
+      uploadFiles(folders[files.first], files.second, sessions, matchContent);
+  }
+  if (stopWatching)
+    printf("Stopped watching folders, %ld photos/videos were not quiet yet and are not uploaded\n", pending.size());
+
+  sigaction(SIGINT, &oldInterruptAction, nullptr);
+  sigaction(SIGTERM, &oldTerminateAction, nullptr);
+  for (auto session : sessions)
+    flickcurl_free(session);
+  close(fd);
+}
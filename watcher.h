@@ -0,0 +1,31 @@
+/*
+ *
+ * flickrsync utility - Watch mode uploading new files as they appear in folders
+ *
+ */
+
+#ifndef WATCHER_H
+#define WATCHER_H
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "photoset.h"
+
+// Folder synced to photoset, kept in memory while watching
+struct watchedFolder {
+  std::string path;
+  std::string setName;
+  std::string setId;
+  PhotoSet photosInSet;
+  // Titles of photos/videos a dry run would have uploaded, not in photosInSet since they have no photo id
+  std::unordered_set<std::string> dryRunUploads;
+};
+
+// Watches folders with inotify and uploads photos/videos that are closed after writing and
+// then quiet for a while, adding them to the photoset of the folder. Returns on SIGINT or SIGTERM
+// once the uploads in progress are done, a second signal terminates right away.
+void watchFolders(std::vector<watchedFolder>& folders, unsigned jobs, bool matchContent);
+
+#endif // WATCHER_H
@@ -0,0 +1,77 @@
+/*
+ *
+ * flickrsync utility - Blocking work queue and concurrent loops shared by worker pools
+ *
+ */
+
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+template <typename T>
+class WorkQueue
+{
+public:
+  void push(T item)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      items.push_back(std::move(item));
+    }
+    available.notify_one();
+  }
+
+  // Waits for the next item, returns false once the queue is closed and drained
+  bool pop(T* item)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    available.wait(lock, [this] { return closed || !items.empty(); });
+    if (items.empty())
+      return false;
+    *item = std::move(items.front());
+    items.pop_front();
+    return true;
+  }
+
+  void close()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      closed = true;
+    }
+    available.notify_all();
+  }
+
+private:
+  std::mutex mutex;
+  std::condition_variable available;
+  std::deque<T> items;
+  bool closed{false};
+};
+
+// Runs work(worker, index) for indexes 0..count-1 on up to threads threads, the calling thread is worker 0
+template <typename Work>
+void runConcurrently(size_t count, unsigned threads, const Work& work)
+{
+  std::atomic<size_t> next{0};
+  auto worker = [&](unsigned workerIndex)
+  {
+    for (auto i = next++; i < count; i = next++)
+      work(workerIndex, i);
+  };
+  std::vector<std::thread> workers;
+  for (unsigned i = 1; i < threads && i < count; ++i)
+    workers.emplace_back(worker, i);
+  worker(0);
+  for (auto& workerThread : workers)
+    workerThread.join();
+}
+
+#endif // WORKQUEUE_H